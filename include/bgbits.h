@@ -0,0 +1,15 @@
+#ifndef __BGBITS_H__
+#define __BGBITS_H__
+
+// number of piece types a board char can hold (low five bits)
+#define BGBITS_TYPES 32
+
+bgbits_row_t bgbits_rotate_right(bgbits_row_t bits, bgbits_row_t top);
+bgbits_row_t bgbits_rotate_left(bgbits_row_t bits,
+                                bgbits_row_t full,
+                                bgbits_row_t top);
+uint8_t bgbits_count(bgbits_row_t bits);
+void bgbits_piece_rows(const game_t *game, uint8_t type, bgbits_row_t *rows);
+uint8_t bgbits_find_sets(const game_t *game, bgbits_row_t *marks);
+
+#endif
@@ -1,19 +1,57 @@
 #ifndef __BGGAME_H__
 #define __BGGAME_H__
 
-// maximum size of the game board
+// maximum size of the game board (the host build may raise these,
+// up to 64 wide and 12 tall, to stress larger boards)
+#ifndef MAX_WIDTH
 #define MAX_WIDTH 20
+#endif
+#ifndef MAX_HEIGHT
 #define MAX_HEIGHT 4
+#endif
+
+// bits per piece when the board is packed (-DBGGAME_PACKED=5, or 4
+// for up to 15 piece types); otherwise each piece is a whole char
+#if defined(BGGAME_PACKED) && BGGAME_PACKED == 4
+#define BGGAME_MAX_VARIETY 15
+#else
+#define BGGAME_MAX_VARIETY 26
+#endif
+#ifdef BGGAME_PACKED
+#define BGGAME_PACKED_MASK ((1 << BGGAME_PACKED)-1)
+// bytes for one row of packed pieces
+#define BGGAME_ROW_BYTES ((MAX_WIDTH*BGGAME_PACKED+7)/8)
+#endif
+
+// ticks between the steps of the space-filling animation
+#define BGGAME_FILL_TICKS 9
+
+// one bit per column of a board row (bit 0 is column 0)
+// MAX_WIDTH must fit in this type
+#if MAX_WIDTH > 32
+typedef uint64_t bgbits_row_t;
+#else
+typedef uint32_t bgbits_row_t;
+#endif
 
 typedef struct {
     // size of the board
     int8_t width, height;
     // number of unique piece types
     int8_t variety;
-    // board state (with enough room for the larges board)
+    // board state (with enough room for the larges board); read and
+    // write it with bggame_type, bggame_piece, and bggame_put
+#ifdef BGGAME_PACKED
+    uint8_t board[MAX_HEIGHT][BGGAME_ROW_BYTES];
+#else
     char board[MAX_HEIGHT][MAX_WIDTH];
+#endif
+    // pieces in sets, waiting to be removed (one bit per column)
+    bgbits_row_t marks[MAX_HEIGHT];
     // score
     uint16_t score;
+    // source of new pieces
+    nkrand_t random;
 } game_t;
 
 // generic "point on the board" structure
@@ -25,26 +63,61 @@ typedef struct {
     uint8_t meta;
 } point_t;
 
+// a refill animation in progress
+typedef struct {
+    // what is on the display
+    char frame[MAX_HEIGHT][MAX_WIDTH];
+    // which columns of each row were spaces, and have not yet
+    // been removed from the frame
+    bgbits_row_t spaces[MAX_HEIGHT];
+    // how many spaces each row had
+    int8_t count[MAX_HEIGHT];
+    // how many steps have been shown, out of how many
+    int8_t step, steps;
+    // the game being filled, for bggame_fill_task
+    const game_t *game;
+} fill_t;
+
 // metadata for point.meta bitfield
 #define PM_SELECTED 1
 
-char bggame_random_piece(game_t game);
+// how a selected piece is shown (as a capital letter)
+#define BGGAME_HIGHLIGHT(piece) ((piece) & ~0x20)
+
+// the piece for a piece type (type 0 is a space, type 1 is 'a')
+#define BGGAME_PIECE(type) ((type) ? 0x60|(type) : ' ')
+
+#ifndef BGGAME_PACKED
+// an unpacked board is read and written in place
+#define bggame_type(game, r, c) ((game)->board[r][c] & 0x1F)
+#define bggame_piece(game, r, c) ((game)->board[r][c])
+#define bggame_put(game, r, c, p) ((game)->board[r][c] = (p))
+#endif
+
+#ifdef BGGAME_PACKED
+uint8_t bggame_type(const game_t *game, int8_t r, int8_t c);
+char bggame_piece(const game_t *game, int8_t r, int8_t c);
+void bggame_put(game_t *game, int8_t r, int8_t c, char piece);
+#endif
+void bggame_read_rows(const game_t *game, char (*rows)[MAX_WIDTH]);
+char bggame_random_piece(game_t *game);
 void bggame_board_init(game_t *game);
-void bggame_move_cursor(game_t game,
+void bggame_deal(game_t *game);
+void bggame_move_cursor(const game_t *game,
                         uint8_t buttons_pushed,
                         point_t *cursor);
 uint8_t bggame_are_neighbor_rowcols(int8_t rc1, int8_t rc2, int8_t max);
-uint8_t bggame_are_neighbors(game_t game,
+uint8_t bggame_are_neighbors(const game_t *game,
                              point_t p1,
                              point_t p2);
 void bggame_invalidate_selection(point_t *selection);
 uint8_t bggame_selection_is_active(point_t selection);
-void bggame_clear_selection(game_t *game, point_t *selection);
-void bggame_set_selection(game_t *game,
+void bggame_clear_selection(const game_t *game, point_t *selection);
+void bggame_set_selection(const game_t *game,
                           point_t *selection,
                           point_t cursor);
-int8_t bggame_next_row(game_t game, int8_t r);
-int8_t bggame_next_column(game_t game, int8_t c);
+int8_t bggame_next_row(const game_t *game, int8_t r);
+int8_t bggame_next_column(const game_t *game, int8_t c);
 uint8_t bggame_match(char a, char b, char c);
 uint8_t bggame_mark_sets(game_t *game);
 uint8_t bggame_remove_sets(game_t *game);
@@ -53,16 +126,30 @@ uint8_t bggame_select(game_t *game,
                       uint8_t buttons_pushed,
                       point_t cursor,
                       point_t *selection);
-void bggame_write_board(game_t game);
-int8_t bggame_first_space(char *row, int8_t width);
+void bggame_write_board(const game_t *game);
 void bggame_shift(char *row, int8_t width, int8_t start);
-uint8_t bggame_fill_spaces_row(game_t game, char *row);
+int8_t bggame_compact_row(game_t *game, int8_t r, int8_t width);
 uint8_t bggame_fill_spaces(game_t *game);
+void bggame_fill_start(game_t *game, fill_t *fill);
+uint8_t bggame_fill_step(const game_t *game, fill_t *fill);
+int16_t bggame_fill_task(void *state);
 void bggame_animate_space_fill(game_t *game);
 void bggame_animate_clear_sets(game_t *game);
 void bggame_clear_marks(game_t *game);
-uint8_t bggame_valid_move(game_t game, point_t a, point_t b);
-uint8_t bggame_valid_move_exists(game_t game);
+int8_t bggame_wrap(int8_t rc, int8_t i, int8_t max);
+char bggame_swapped_piece(const game_t *game,
+                          point_t a,
+                          point_t b,
+                          int8_t r,
+                          int8_t c);
+uint8_t bggame_swap_makes_set(const game_t *game,
+                              point_t a,
+                              point_t b,
+                              point_t p);
+uint8_t bggame_valid_move(const game_t *game, point_t a, point_t b);
+uint8_t bggame_valid_move_exists(const game_t *game);
+int16_t bggame_play_task(void *state);
+int16_t bggame_hint_task(void *state);
 void bggame_play(game_t *game);
 void bggame_over(uint16_t score);
 #endif
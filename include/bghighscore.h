@@ -5,6 +5,33 @@
 #define HIGH_SCORES 3
 #define INITIALS 3
 
+// bytes in the table
+#define BGHIGHSCORE_BYTES (HIGH_SCORES*sizeof(bghighscore_t))
+// where the one shared table lived before saves were spread across
+// the EEPROM (the table, then its checksum)
+#define BGHIGHSCORE_LEGACY 0
+// then the ring of saved shared tables, after the legacy copy
+#define BGHIGHSCORE_RING (BGHIGHSCORE_LEGACY+BGHIGHSCORE_BYTES+1)
+#define BGHIGHSCORE_RING_SLOTS \
+    ((NKEEPROM_SIZE-BGHIGHSCORE_RING)/(BGHIGHSCORE_BYTES+2))
+// now, one table per board configuration, kept in a table store
+// covering the whole EEPROM (25 slots, at most 32 for its valid mask);
+// version 2 widened the sequence numbers, and a version 1 store is
+// formatted over
+#define BGHIGHSCORE_TABLES 0
+#define BGHIGHSCORE_VERSION 2
+#define BGHIGHSCORE_SLOTS                                       \
+    ((NKEEPROM_SIZE-BGHIGHSCORE_TABLES-NKEEPROM_HEADER)/        \
+     (NKEEPROM_ENTRY+BGHIGHSCORE_BYTES+1))
+
+// a board configuration's key in the store
+// (width up to 31, height up to 7, variety up to 31)
+#define BGHIGHSCORE_KEY(width, height, variety)         \
+    (((uint16_t)(width) << 8) | ((height) << 5) | (variety))
+#define BGHIGHSCORE_KEY_WIDTH(key)   ((key) >> 8)
+#define BGHIGHSCORE_KEY_HEIGHT(key)  (((key) >> 5) & 0x07)
+#define BGHIGHSCORE_KEY_VARIETY(key) ((key) & 0x1F)
+
 // the high score table
 typedef struct {
     // initials of the player that made the score
@@ -13,15 +40,25 @@ typedef struct {
     uint16_t score;
 } bghighscore_t;
 
-void bghighscore_init();
+void bghighscore_init(const game_t *game);
+void bghighscore_migrate();
 uint8_t bghighscore_checksum();
+uint8_t bghighscore_valid();
+uint8_t bghighscore_read_legacy();
+uint8_t bghighscore_read_ring(uint16_t *address);
 uint8_t bghighscore_read();
+void bghighscore_load(const game_t *game);
 void bghighscore_clear();
 void bghighscore_write();
 void bghighscore_display_line(int8_t rank, int8_t lcd_line);
 void bghighscore_screen();
+#ifdef NKPROF
+int16_t bghighscore_delay_task(void *state);
+#endif
+void bghighscore_delay(int16_t clicks);
 void bghighscore_alter_initials(uint8_t buttons, int8_t rank, int8_t i);
 uint8_t bghighscore_move_cursor(uint8_t buttons, int8_t *i);
+int16_t bghighscore_new_task(void *state);
 void bghighscore_new(int8_t rank, uint16_t score);
 void bghighscore_maybe(uint16_t score);
 
@@ -0,0 +1,29 @@
+#ifndef __BGHINT_H__
+#define __BGHINT_H__
+
+// buttons held together to ask for a hint
+#define BGHINT_BUTTONS (B_UP|B_DOWN)
+
+// cells checked per idle animation tick (two swaps each)
+#define BGHINT_CELLS 4
+
+// state of the hint search, carried between ticks
+typedef struct {
+    // the next cell whose right and below swaps will be checked
+    point_t next;
+    // the best swap found so far
+    point_t a, b;
+    // score of the best swap (0 if none found yet)
+    uint8_t score;
+} bghint_t;
+
+void bghint_reset(bghint_t *hint);
+uint8_t bghint_done(const game_t *game, const bghint_t *hint);
+uint8_t bghint_score(const game_t *game, point_t a, point_t b);
+void bghint_consider(const game_t *game,
+                     bghint_t *hint,
+                     point_t a,
+                     point_t b);
+void bghint_step(const game_t *game, bghint_t *hint, int8_t cells);
+
+#endif
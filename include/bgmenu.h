@@ -12,6 +12,7 @@ int8_t bgmenu_field_and_limits(int8_t prompt, game_t *game,
                                int8_t **field, int8_t *min, int8_t *max);
 void bgmenu_increase_prompt(int8_t prompt, game_t *game);
 void bgmenu_decrease_prompt(int8_t prompt, game_t *game);
+int16_t bgmenu_task(void *state);
 uint8_t bgmenu_display(game_t *game);
 
 #endif
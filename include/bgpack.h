@@ -0,0 +1,40 @@
+#ifndef __BGPACK_H__
+#define __BGPACK_H__
+
+// bits per piece in a packed column (enough for BGBITS_TYPES)
+#define BGPACK_BITS 5
+#define BGPACK_MASK 0x1F
+
+// one board column, row r's piece type in bits 5r to 5r+4
+// MAX_HEIGHT*BGPACK_BITS must fit in this type
+#if MAX_HEIGHT*BGPACK_BITS > 32
+typedef uint64_t bgpack_column_t;
+#else
+typedef uint32_t bgpack_column_t;
+#endif
+
+// masks for the columns of a board of one height
+typedef struct {
+    // the low four bits of every row's field
+    bgpack_column_t low;
+    // the top bit of every row's field
+    bgpack_column_t high;
+    // every row's whole field
+    bgpack_column_t full;
+    // shift from row 0's field to the bottom row's
+    int8_t bottom;
+} bgpack_shape_t;
+
+void bgpack_shape(bgpack_shape_t *shape, int8_t height);
+bgpack_column_t bgpack_column(const game_t *game, int8_t c);
+bgpack_column_t bgpack_down(bgpack_column_t column,
+                            const bgpack_shape_t *shape);
+bgpack_column_t bgpack_up(bgpack_column_t column,
+                          const bgpack_shape_t *shape);
+bgpack_column_t bgpack_nonzero(bgpack_column_t x,
+                               const bgpack_shape_t *shape);
+bgpack_column_t bgpack_column_sets(bgpack_column_t column,
+                                   const bgpack_shape_t *shape);
+void bgpack_vertical_sets(const game_t *game, bgbits_row_t *marks);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef __BGPRESET_H__
+#define __BGPRESET_H__
+
+// Board sizes that get their own copy of the routines in bgpreset.inc,
+// with the width and height fixed so the compiler can fold and unroll
+// the loops over them. Each is turned on by a build flag, for
+// example -DBGPRESET_20X4 (see PRESETS in the Makefile). Other sizes
+// use the copy that reads the size from the game.
+
+// declare one copy of the routines
+#define BGPRESET_PROTOTYPES(suffix)                                     \
+    uint8_t bgpreset_find_sets_##suffix(const game_t *game,             \
+                                        bgbits_row_t *marks);           \
+    uint8_t bgpreset_valid_move_exists_##suffix(const game_t *game);    \
+    uint8_t bgpreset_fill_spaces_##suffix(game_t *game);
+
+BGPRESET_PROTOTYPES(any)
+#ifdef BGPRESET_20X4
+BGPRESET_PROTOTYPES(20x4)
+#endif
+#ifdef BGPRESET_10X3
+BGPRESET_PROTOTYPES(10x3)
+#endif
+
+uint8_t bgpreset_find_sets(const game_t *game, bgbits_row_t *marks);
+uint8_t bgpreset_valid_move_exists(const game_t *game);
+uint8_t bgpreset_fill_spaces(game_t *game);
+
+#endif
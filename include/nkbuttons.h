@@ -7,6 +7,7 @@
 #define B_UP     (1<<PC2)
 #define B_RIGHT  (1<<PC3)
 #define B_SELECT (1<<PC4)
+#define B_ALL    (B_LEFT|B_DOWN|B_UP|B_RIGHT|B_SELECT)
 
 #define B_LEFT_INT   (1<<PCINT8)
 #define B_DOWN_INT   (1<<PCINT9)
@@ -14,22 +15,37 @@
 #define B_RIGHT_INT  (1<<PCINT11)
 #define B_SELECT_INT (1<<PCINT12)
 
-// living state for the button reader
+// number of buttons (PC0 through PC4)
+#define NKBUTTONS_COUNT 5
+// number of events that can wait to be read
+#define NKBUTTONS_QUEUE 8
+// ticks a button ignores further edges for after one is accepted
+// (its contacts bounce for a few milliseconds)
+#define NKBUTTONS_LOCKOUT 2
+// ticks a button must be held before it repeats, and between repeats
+#define NKBUTTONS_REPEAT_FIRST 30
+#define NKBUTTONS_REPEAT 14
+
+// buttons pushed (or repeated), and the tick it happened on
+typedef struct {
+    uint8_t buttons;
+    uint8_t tick;
+} nkbuttons_event_t;
+
+// living state for a button reader
 typedef struct {
-    // the stable state (repeated agreeing reads) of the buttons
+    // the buttons held down as of the last read
     uint8_t stable;
-    // the most recent read of the buttons
-    uint8_t last_read;
-    // number of times stable state has been read
-    uint8_t stable_count;
-    // whether or not key triggers are currently repeats
-    // (smaller delay between firings after first repeat)
-    uint8_t is_repeat;
+    // the tick of the last event read
+    uint8_t tick;
 } nkbuttons_t;
 
 void nkbuttons_init();
 void nkbuttons_enable_interrupts();
-void nkbuttons_disable_interrupts();
+void nkbuttons_sample();
+void nkbuttons_push(uint8_t buttons);
+void nkbuttons_tick();
+uint8_t nkbuttons_next(nkbuttons_event_t *event);
 uint8_t nkbuttons_read(nkbuttons_t *state);
 void nkbuttons_clear(nkbuttons_t *state);
 
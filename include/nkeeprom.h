@@ -1,9 +1,130 @@
 #ifndef __NKEEPROM_H__
 #define __NKEEPROM_H__
 
+// bytes of EEPROM on the ATmega168
+#define NKEEPROM_SIZE 512
+
+// number of writes that can be queued at once
+#define NKEEPROM_JOBS 3
+
+// mixed into each ring record's check byte, so that erased (0xFF)
+// or zeroed memory doesn't pass as a record
+#define NKEEPROM_CHECK 0x5A
+
+// first bytes of a table store's header (the third is its version)
+#define NKEEPROM_MAGIC0 'n'
+#define NKEEPROM_MAGIC1 'k'
+#define NKEEPROM_HEADER 3
+// bytes in a table store's index entry: key (high, low), sequence
+// (high, low)
+#define NKEEPROM_ENTRY 4
+// the key of an empty index entry
+#define NKEEPROM_EMPTY 0xFFFF
+// polynomial of the records' CRC-8 (x^8 + x^2 + x + 1)
+#define NKEEPROM_CRC8 0x07
+
+// a queued write: count bytes from src, starting at address
+typedef struct {
+    unsigned char *src;
+    uint16_t address;
+    uint8_t count;
+} nkeeprom_job_t;
+
+// a ring of fixed-size records, each stored as its payload, then a
+// check byte, then a sequence number (written last, so a record only
+// counts once all of it has reached the EEPROM); only read now, to
+// carry saves over to a table store
+typedef struct {
+    // address of the first slot
+    uint16_t base;
+    // number of slots, less than 128 so sequence numbers stay ordered
+    uint8_t slots;
+    // payload bytes in each record
+    uint8_t size;
+    // slot holding the newest valid record (-1 if none)
+    int8_t newest;
+    // sequence number of the newest record
+    uint8_t sequence;
+} nkeeprom_ring_t;
+
+// records found by a 16-bit key, laid out as a header, then an
+// index with one entry per slot, then the slots' records (payload,
+// then a CRC-8 covering the index entry and the payload)
+// a record only counts once its index entry is written, which is last
+// sequence numbers come from one counter shared by every key, and a
+// key's only record stays put however many saves of other keys pass
+// it, so they are 16 bits: they stay ordered as long as every record
+// is within 32768 saves of the newest
+typedef struct {
+    // address of the header
+    uint16_t base;
+    // version of the records' format
+    uint8_t version;
+    // number of slots (at most 32)
+    uint8_t slots;
+    // payload bytes in each record
+    uint8_t size;
+    // one bit per slot whose record is whole
+    uint32_t valid;
+    // sequence number of the newest record
+    uint16_t sequence;
+    // index entry and CRC of the record being written
+    unsigned char entry[NKEEPROM_ENTRY];
+    uint8_t crc;
+} nkeeprom_tables_t;
+
+char nkeeprom_read_now(uint16_t address);
+void nkeeprom_store(char byte, uint16_t address);
+uint8_t nkeeprom_busy();
+void nkeeprom_wait();
+void nkeeprom_write_async(unsigned char *src,
+                          uint16_t address,
+                          uint8_t count);
 char nkeeprom_read_byte(uint16_t address);
 void nkeeprom_write_byte(char byte, uint16_t address);
+uint8_t nkeeprom_update_byte(char byte, uint16_t address);
 void nkeeprom_read_bytes(unsigned char *dest, uint16_t offset, int16_t count);
-void nkeeprom_write_bytes(unsigned char *src, uint16_t offset, int16_t count);
+void nkeeprom_ring_init(nkeeprom_ring_t *ring,
+                        uint16_t base,
+                        uint8_t slots,
+                        uint8_t size);
+uint16_t nkeeprom_ring_address(nkeeprom_ring_t *ring, int8_t slot);
+uint8_t nkeeprom_ring_check(unsigned char *payload,
+                            uint8_t size,
+                            uint8_t sequence);
+uint8_t nkeeprom_ring_valid(nkeeprom_ring_t *ring, int8_t slot);
+uint8_t nkeeprom_ring_read(nkeeprom_ring_t *ring, unsigned char *dest);
+uint8_t nkeeprom_crc8(uint8_t crc, unsigned char *data, uint8_t count);
+void nkeeprom_tables_init(nkeeprom_tables_t *tables,
+                          uint16_t base,
+                          uint8_t version,
+                          uint8_t slots,
+                          uint8_t size);
+uint8_t nkeeprom_tables_formatted(nkeeprom_tables_t *tables);
+void nkeeprom_tables_format(nkeeprom_tables_t *tables);
+void nkeeprom_tables_format_keeping(nkeeprom_tables_t *tables, int8_t keep);
+void nkeeprom_tables_migrate(nkeeprom_tables_t *tables,
+                             uint16_t key,
+                             unsigned char *src,
+                             uint16_t from,
+                             uint16_t to);
+uint8_t nkeeprom_tables_recover(nkeeprom_tables_t *tables);
+uint16_t nkeeprom_tables_entry(nkeeprom_tables_t *tables, int8_t slot);
+uint16_t nkeeprom_tables_record(nkeeprom_tables_t *tables, int8_t slot);
+uint16_t nkeeprom_tables_key(nkeeprom_tables_t *tables, int8_t slot);
+uint16_t nkeeprom_tables_sequence(nkeeprom_tables_t *tables, int8_t slot);
+void nkeeprom_tables_scan(nkeeprom_tables_t *tables);
+int8_t nkeeprom_tables_find(nkeeprom_tables_t *tables, uint16_t key);
+int8_t nkeeprom_tables_victim(nkeeprom_tables_t *tables);
+uint8_t nkeeprom_tables_read(nkeeprom_tables_t *tables,
+                             uint16_t key,
+                             unsigned char *dest);
+void nkeeprom_tables_write(nkeeprom_tables_t *tables,
+                           uint16_t key,
+                           unsigned char *src);
+void nkeeprom_tables_put(nkeeprom_tables_t *tables,
+                         int8_t slot,
+                         uint16_t key,
+                         unsigned char *src);
 
 #endif
@@ -6,10 +6,54 @@
 #define DISPLAY_CURSOR 0x02
 #define DISPLAY_ON     0x04
 
+#define CLEAR_CMD      0x01
+#define ADDRESS_CMD    0x80
+
+// size of the display
+#define NKLCD_ROWS    4
+#define NKLCD_COLUMNS 20
+
+// number of bytes that can wait to be sent to the display
+#define NKLCD_QUEUE 32
+// how often the queue sends a byte (80us, as long as lcd_write_byte
+// waits after each byte)
+#define NKLCD_QUEUE_HZ 12500
+// extra queue ticks to wait after a clear (which takes 1.52ms)
+#define NKLCD_CLEAR_TICKS 25
+// queue entries cell writes leave free for commands; past that, cells
+// are only noted in the shadow, and the queue's interrupt sends them
+// once it runs dry
+#define NKLCD_QUEUE_SPARE 4
+
+// flags in the high byte of a queue entry
+#define NKLCD_Q_COMMAND 0x100
+#define NKLCD_Q_SLOW    0x200
+
+uint8_t nklcd_next_dirty(uint16_t *entry);
+uint16_t nklcd_next_queued();
 void nklcd_init();
 void nklcd_start_blinking();
 void nklcd_stop_blinking();
 void nklcd_off();
 void nklcd_on();
+void nklcd_queue_start();
+void nklcd_queue_stop();
+uint8_t nklcd_dirty_cells();
+void nklcd_flush();
+void nklcd_send(uint16_t entry);
+uint8_t nklcd_room();
+void nklcd_command(uint8_t command);
+void nklcd_goto_position(uint8_t row, uint8_t column);
+void nklcd_write_data(char c);
+void nklcd_write_string(const char *s);
+void nklcd_write_int16(int16_t in);
+uint8_t nklcd_address(int8_t row, int8_t column);
+void nklcd_mark_cell(int8_t row, int8_t column, char c);
+void nklcd_clear();
+void nklcd_write_cell(int8_t row, int8_t column, char c);
+void nklcd_write_grid(const char *cells,
+                      int8_t stride,
+                      int8_t rows,
+                      int8_t columns);
 
 #endif
@@ -0,0 +1,44 @@
+#ifndef __NKPROF_H__
+#define __NKPROF_H__
+
+// regions the profiler keeps totals for
+#define NKPROF_MARK_SETS  0
+#define NKPROF_VALID_MOVE 1
+#define NKPROF_FILL       2
+#define NKPROF_LCD        3
+#define NKPROF_EEPROM     4
+#define NKPROF_REGIONS    5
+
+// buttons held together on the high score screen to show the totals
+#define NKPROF_CHORD (B_UP|B_DOWN)
+
+#ifdef NKPROF
+
+// calls into a region (stopping at 0xFFFF), and the cycles spent in
+// it (wrapping after about 291 seconds at 14.7456MHz)
+typedef struct {
+    uint16_t calls;
+    uint32_t cycles;
+} nkprof_total_t;
+
+extern nkprof_total_t nkprof_totals[NKPROF_REGIONS];
+
+void nkprof_init();
+void nkprof_reset();
+uint32_t nkprof_now();
+void nkprof_start(uint8_t region);
+void nkprof_stop(uint8_t region);
+void nkprof_screen();
+
+#define NKPROF_START(region) nkprof_start(region)
+#define NKPROF_STOP(region)  nkprof_stop(region)
+
+#else
+
+// without NKPROF (make PROFILE=1), the profiler compiles to nothing
+#define NKPROF_START(region)
+#define NKPROF_STOP(region)
+
+#endif
+
+#endif
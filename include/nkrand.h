@@ -6,4 +6,12 @@ void nkrand_close();
 uint8_t nkrand_next_bit();
 uint16_t nkrand_seed();
 
+// state of a pseudo-random sequence, so that a sequence can be
+// repeated by starting again from the same seed
+typedef uint16_t nkrand_t;
+
+void nkrand_start(nkrand_t *state, uint16_t seed);
+uint16_t nkrand_next(nkrand_t *state);
+uint8_t nkrand_below(nkrand_t *state, uint8_t n);
+
 #endif
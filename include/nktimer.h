@@ -3,10 +3,52 @@
 
 #define F_CPU 14745600
 
+// screens that keep their own count of frames and overruns
+#define NKTIMER_MENU      0
+#define NKTIMER_GAME      1
+#define NKTIMER_HIGHSCORE 2
+#define NKTIMER_OVER      3
+#define NKTIMER_SCREENS   4
+
+// frames a screen waited for, and ticks they overran by
+// (both stop at 0xFFFF)
+typedef struct {
+    uint16_t frames;
+    uint16_t overruns;
+} nktimer_frames_t;
+
+extern nktimer_frames_t nktimer_frames[NKTIMER_SCREENS];
+
+// a task does one tick's worth of work, and returns the number of
+// ticks until it should run again (0 when it is finished)
+typedef int16_t (*nktimer_task_t)(void *state);
+
+// tasks the scheduler holds at once (a screen, the hint search beside
+// it, and an animation or delay the screen is waiting on)
+#define NKTIMER_TASKS 4
+
+// a place in the scheduler's table
+typedef struct {
+    // what to run (0 for an empty slot), and what to run it on
+    nktimer_task_t task;
+    void *state;
+    // ticks until it runs again
+    int16_t ticks;
+    // set while it runs, so a nested dispatch passes over it
+    uint8_t running;
+} nktimer_slot_t;
+
 void nktimer_init(int8_t freq);
 void nktimer_resume();
 void nktimer_pause();
-uint8_t nktimer_animate();
+uint16_t nktimer_now();
+void nktimer_screen(uint8_t screen);
+uint16_t nktimer_animate();
+uint16_t nktimer_wait();
+int8_t nktimer_add(nktimer_task_t task, void *state, int16_t ticks);
+void nktimer_remove(int8_t slot);
+void nktimer_dispatch();
+void nktimer_run(nktimer_task_t task, void *state, int16_t ticks);
 void nktimer_simple_delay(int16_t clicks);
 
 #endif
@@ -0,0 +1,60 @@
+// blockgame
+// for NerdKits with ATmega168
+// copyright 2011 Bryan Fink
+// license: see LICENSE.txt
+
+// finding sets with one bitmask per row per piece type
+
+#include <inttypes.h>
+
+#include "nkrand.h"
+
+#include "bggame.h"
+#include "bgbits.h"
+#include "bgpreset.h"
+
+// rotate a row one column to the right (column c+1 moves to c),
+// wrapping column 0 around to the far right
+// (top is the far-right column's bit)
+bgbits_row_t bgbits_rotate_right(bgbits_row_t bits, bgbits_row_t top) {
+    return (bits >> 1) | ((bits & 1) ? top : 0);
+}
+
+// rotate a row one column to the left (column c moves to c+1),
+// wrapping the far-right column around to column 0
+// (full has one bit per column)
+bgbits_row_t bgbits_rotate_left(bgbits_row_t bits,
+                                bgbits_row_t full,
+                                bgbits_row_t top) {
+    return ((bits << 1) & full) | ((bits & top) ? 1 : 0);
+}
+
+// count the columns set in a row
+uint8_t bgbits_count(bgbits_row_t bits) {
+    uint8_t count;
+    // each step clears the lowest set bit
+    for (count = 0; bits; count++)
+        bits &= bits-1;
+    return count;
+}
+
+// build the bitmask of each row for the given piece type
+void bgbits_piece_rows(const game_t *game, uint8_t type, bgbits_row_t *rows) {
+    int8_t r, c;
+    bgbits_row_t bits;
+    for (r = 0; r < game->height; r++) {
+        // walk backward so each column can be shifted in from the top
+        for (bits = 0, c = game->width-1; c >= 0; c--) {
+            bits <<= 1;
+            if (bggame_type(game, r, c) == type)
+                bits |= 1;
+        }
+        rows[r] = bits;
+    }
+}
+
+// find all sets on the board, without modifying it
+// marks gets one row bitmask per board row, set for each piece in a set
+uint8_t bgbits_find_sets(const game_t *game, bgbits_row_t *marks) {
+    return bgpreset_find_sets(game, marks);
+}
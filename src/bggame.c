@@ -5,22 +5,65 @@
 
 // logic for actually playing the game
 
-#include <stdlib.h>
 #include <inttypes.h>
 #include <avr/pgmspace.h>
 
-#include "lcd.h"
-
 #include "nkbuttons.h"
 #include "nklcd.h"
+#include "nkrand.h"
 #include "nktimer.h"
 #include "nksleep.h"
+#include "nkprof.h"
 
 #include "bggame.h"
+#include "bgbits.h"
+#include "bghint.h"
+#include "bgpreset.h"
 #include "bghighscore.h"
 
-char bggame_random_piece(game_t game) {
-    return 'a'+(rand() % game.variety);
+// (bgbits_row_t holds 64 columns, bgpack_column_t holds 12 rows)
+#if MAX_WIDTH > 64 || MAX_HEIGHT > 12 || MAX_HEIGHT > MAX_WIDTH
+#error "boards are at most 64 wide and 12 tall, and no taller than wide"
+#endif
+
+#ifdef BGGAME_PACKED
+// the type of the piece at row r, column c of a packed board; each
+// piece's bits may run over into the next byte
+uint8_t bggame_type(const game_t *game, int8_t r, int8_t c) {
+    uint16_t bit = c*BGGAME_PACKED;
+    const uint8_t *bytes = &game->board[r][bit >> 3];
+    uint16_t bits = bytes[0];
+    if ((bit & 7)+BGGAME_PACKED > 8)
+        bits |= bytes[1] << 8;
+    return (bits >> (bit & 7)) & BGGAME_PACKED_MASK;
+}
+
+char bggame_piece(const game_t *game, int8_t r, int8_t c) {
+    return BGGAME_PIECE(bggame_type(game, r, c));
+}
+
+// put a piece (or a space) at row r, column c of a packed board
+void bggame_put(game_t *game, int8_t r, int8_t c, char piece) {
+    uint16_t bit = c*BGGAME_PACKED;
+    uint8_t *bytes = &game->board[r][bit >> 3];
+    uint16_t mask = BGGAME_PACKED_MASK << (bit & 7);
+    uint16_t bits = (piece & BGGAME_PACKED_MASK) << (bit & 7);
+    bytes[0] = (bytes[0] & ~mask) | bits;
+    if ((bit & 7)+BGGAME_PACKED > 8)
+        bytes[1] = (bytes[1] & ~(mask >> 8)) | (bits >> 8);
+}
+#endif
+
+// copy the pieces of the board into rows of chars
+void bggame_read_rows(const game_t *game, char (*rows)[MAX_WIDTH]) {
+    int8_t r, c;
+    for (r = 0; r < game->height; r++)
+        for (c = 0; c < game->width; c++)
+            rows[r][c] = bggame_piece(game, r, c);
+}
+
+char bggame_random_piece(game_t *game) {
+    return 'a'+nkrand_below(&game->random, game->variety);
 }
 
 // initialize the board
@@ -28,11 +71,41 @@ void bggame_board_init(game_t *game) {
     int8_t r,c;
     for (r = 0; r < game->height; r++)
         for (c = 0; c < game->width; c++)
-            game->board[r][c] = ' ';
+            bggame_put(game, r, c, ' ');
+    bggame_clear_marks(game);
+}
+
+// deal a board ready to play: no sets (across the wrapped edges,
+// too), and at least one valid move
+void bggame_deal(game_t *game) {
+    point_t p = {0, 0, 0};
+    int8_t tries;
+    char piece;
+    do {
+        bggame_board_init(game);
+        for (p.row = 0; p.row < game->height; p.row++)
+            for (p.column = 0; p.column < game->width; p.column++) {
+                // if the piece drawn would finish a set with the pieces
+                // dealt so far, try the next type instead, and so on
+                piece = bggame_random_piece(game);
+                for (tries = game->variety; tries > 0; tries--) {
+                    bggame_put(game, p.row, p.column, piece);
+                    if (!bggame_swap_makes_set(game, p, p, p))
+                        break;
+                    if (++piece >= 'a'+game->variety)
+                        piece = 'a';
+                }
+            }
+        // a cell hemmed in by every type can still finish a set
+        while (bggame_mark_sets(game)) {
+            bggame_remove_sets(game);
+            bggame_fill_spaces(game);
+        }
+    } while (!bggame_valid_move_exists(game));
 }
 
 // handle any directional button pushes
-void bggame_move_cursor(game_t game,
+void bggame_move_cursor(const game_t *game,
                         uint8_t buttons_pushed,
                         point_t *cursor) {
     if (buttons_pushed & B_UP)
@@ -44,15 +117,15 @@ void bggame_move_cursor(game_t game,
     if (buttons_pushed & B_RIGHT)
         cursor->column++;
 
-    if (cursor->row > (game.height-1))
+    if (cursor->row > (game->height-1))
         cursor->row = 0;
     else if (cursor->row < 0)
-        cursor->row = (game.height-1);
+        cursor->row = (game->height-1);
 
-    if (cursor->column > (game.width-1))
+    if (cursor->column > (game->width-1))
         cursor->column = 0;
     else if (cursor->column < 0)
-        cursor->column = (game.width-1);
+        cursor->column = (game->width-1);
 }
 
 // return true if the given columns/rows are neighbors
@@ -65,13 +138,13 @@ uint8_t bggame_are_neighbor_rowcols(int8_t rc1, int8_t rc2, int8_t max) {
 }
 
 // return true if the given points are neighbors
-uint8_t bggame_are_neighbors(game_t game,
+uint8_t bggame_are_neighbors(const game_t *game,
                              point_t p1,
                              point_t p2) {
     if (p1.row == p2.row)
-        return bggame_are_neighbor_rowcols(p1.column, p2.column, game.width);
+        return bggame_are_neighbor_rowcols(p1.column, p2.column, game->width);
     else if (p1.column == p2.column)
-        return bggame_are_neighbor_rowcols(p1.row, p2.row, game.height);
+        return bggame_are_neighbor_rowcols(p1.row, p2.row, game->height);
     return 0;
 }
 
@@ -83,94 +156,71 @@ uint8_t bggame_selection_is_active(point_t selection) {
     return selection.meta & PM_SELECTED;
 }
 
-void bggame_clear_selection(game_t *game, point_t *selection) {
-    if (bggame_selection_is_active(*selection))
-        game->board[selection->row][selection->column] |= 0x20;
-    lcd_goto_position(selection->row, selection->column);
-    lcd_write_data(game->board[selection->row][selection->column]);
+// the selection is only shown on the display; the board is untouched
+void bggame_clear_selection(const game_t *game, point_t *selection) {
+    nklcd_write_cell(selection->row, selection->column,
+                     bggame_piece(game, selection->row, selection->column));
     bggame_invalidate_selection(selection);
 }
 
-void bggame_set_selection(game_t *game,
+void bggame_set_selection(const game_t *game,
                           point_t *selection,
                           point_t cursor) {
     selection->row = cursor.row;
     selection->column = cursor.column;
     selection->meta |= PM_SELECTED;
-    game->board[selection->row][selection->column] &= ~0x20;
-    lcd_goto_position(selection->row, selection->column);
-    lcd_write_data(game->board[selection->row][selection->column]);
+    nklcd_write_cell(selection->row, selection->column,
+                     BGGAME_HIGHLIGHT(bggame_piece(game, selection->row,
+                                                   selection->column)));
 }
 
 // return the index to the row to the "right" of the given row
-int8_t bggame_next_row(game_t game, int8_t r) {
-    if (++r > (game.height-1)) return 0;
+int8_t bggame_next_row(const game_t *game, int8_t r) {
+    if (++r > (game->height-1)) return 0;
     return r;
 }
 
 // return the index to the column "below" the given column
-int8_t bggame_next_column(game_t game, int8_t c) {
-    if (++c > (game.width-1)) return 0;
+int8_t bggame_next_column(const game_t *game, int8_t c) {
+    if (++c > (game->width-1)) return 0;
     return c;
 }
 
 // determine if a, b, and c are the same piece
 uint8_t bggame_match(char a, char b, char c) {
-    return ((0x1F & b) == (0x1F & a)) && ((0x1F & b) == (0x1F & c));
+    return (b == a) && (b == c);
 }
 
-// mark all sets on the board (as capital letters)
+// mark all sets on the board (in game->marks)
 uint8_t bggame_mark_sets(game_t *game) {
-    int8_t r, nr, nnr, c, nc, nnc, found=0;
-    for(r=0, nr=bggame_next_row(*game, r), nnr=bggame_next_row(*game, nr);
-        r < game->height;
-        r++, nr=bggame_next_row(*game, nr), nnr=bggame_next_row(*game, nnr)) {
-        for(c=0, nc=bggame_next_column(*game, c),
-                nnc=bggame_next_column(*game, nc);
-            c < game->width;
-            c++, nc=bggame_next_column(*game, nc),
-                nnc=bggame_next_column(*game, nnc)) {
-            if(bggame_match(game->board[r][c],
-                            game->board[r][nc],
-                            game->board[r][nnc])) {
-                found = 1;
-                game->board[r][c] &= ~0x20;
-                game->board[r][nc] &= ~0x20;
-                game->board[r][nnc] &= ~0x20;
-            }
-            if(bggame_match(game->board[r][c],
-                            game->board[nr][c],
-                            game->board[nnr][c])) {
-                found = 1;
-                game->board[r][c] &= ~0x20;
-                game->board[nr][c] &= ~0x20;
-                game->board[nnr][c] &= ~0x20;
-            }
-        }
-    }
+    uint8_t found;
+    NKPROF_START(NKPROF_MARK_SETS);
+    found = bgbits_find_sets(game, game->marks);
+    NKPROF_STOP(NKPROF_MARK_SETS);
     return found;
 }
 
 // remove all sets on the board (as previously marked)
 uint8_t bggame_remove_sets(game_t *game) {
     int8_t r, c;
+    bgbits_row_t bits;
     uint8_t removed = 0;
     for(r=0; r < game->height; r++) {
-        for(c=0; c < game->width; c++) {
-            if ((game->board[r][c] & 0x20) == 0) {
-                game->board[r][c] = ' ';
-                removed++;
-            }
-        }
+        removed += bgbits_count(game->marks[r]);
+        // stop at the last marked column
+        for (c = 0, bits = game->marks[r]; bits; c++, bits >>= 1)
+            if (bits & 1)
+                bggame_put(game, r, c, ' ');
+        game->marks[r] = 0;
     }
     return removed;
 }
 
 // move the piece at a to position b, and the piece at b to positiona
 void bggame_swap_pieces(game_t *game, point_t a, point_t b) {
-    char p = game->board[a.row][a.column];
-    game->board[a.row][a.column] = game->board[b.row][b.column];
-    game->board[b.row][b.column] = p;
+    char p = bggame_piece(game, a.row, a.column);
+    bggame_put(game, a.row, a.column, bggame_piece(game, b.row, b.column));
+    bggame_put(game, b.row, b.column, p);
 }
 
 // handle a select button push
@@ -180,7 +230,7 @@ uint8_t bggame_select(game_t *game,
                       point_t *selection) {
     if (buttons_pushed & B_SELECT) {
         if (bggame_selection_is_active(*selection)) {
-            if (bggame_are_neighbors(*game, *selection, cursor)) {
+            if (bggame_are_neighbors(game, *selection, cursor)) {
                 bggame_clear_selection(game, selection);
                 bggame_swap_pieces(game, *selection, cursor);
                 if (bggame_mark_sets(game))
@@ -199,22 +249,17 @@ uint8_t bggame_select(game_t *game,
     return 0;
 }
 
-void bggame_write_board(game_t game) {
-    int8_t r, c;
-    for (r=0; r < game.height; r++) {
-        lcd_goto_position(r, 0);
-        for (c=0; c < game.width; c++) {
-            lcd_write_data(game.board[r][c]);
-        }
-    }
-}
-
-int8_t bggame_first_space(char *row, int8_t width) {
-    int8_t c;
-    for (c = 0; c < width; c++)
-        if (row[c] == ' ')
-            break;
-    return c;
+// bring the display up to date with the board
+// (only pieces that changed since the last write are sent)
+void bggame_write_board(const game_t *game) {
+#ifdef BGGAME_PACKED
+    char rows[MAX_HEIGHT][MAX_WIDTH];
+    bggame_read_rows(game, rows);
+    nklcd_write_grid(&rows[0][0], MAX_WIDTH, game->height, game->width);
+#else
+    nklcd_write_grid(&game->board[0][0], MAX_WIDTH,
+                     game->height, game->width);
+#endif
 }
 
 void bggame_shift(char *row, int8_t width, int8_t start) {
@@ -222,36 +267,82 @@ void bggame_shift(char *row, int8_t width, int8_t start) {
         row[start] = row[start+1];
 }
 
-uint8_t bggame_fill_spaces_row(game_t game, char *row) {
-    int8_t first_space = bggame_first_space(row, game.width);
-    if (first_space < game.width) {
-        bggame_shift(row, game.width, first_space);
-        row[(game.width-1)] = bggame_random_piece(game);
-        return 1;
-    } else
-        return 0;
+// slide the pieces in row r left over any spaces, leaving the
+// spaces at the right end; returns the number of spaces
+int8_t bggame_compact_row(game_t *game, int8_t r, int8_t width) {
+    int8_t from, to;
+    for (from = 0, to = 0; from < width; from++)
+        if (bggame_type(game, r, from)) {
+            if (to != from)
+                bggame_put(game, r, to, bggame_piece(game, r, from));
+            to++;
+        }
+    for (from = to; from < width; from++)
+        bggame_put(game, r, from, ' ');
+    return width-to;
 }
 
+// refill every space on the board in one pass: the pieces in each
+// row slide left over its spaces, and new pieces fill in on the right
+// returns the most spaces any row had (the number of animation steps)
 uint8_t bggame_fill_spaces(game_t *game) {
-    int r, spaces = 0;
-    for(r = 0; r < game->height; r++) {
-        spaces |= bggame_fill_spaces_row(*game, game->board[r]);
-    }
-    return spaces;
+    uint8_t steps;
+    NKPROF_START(NKPROF_FILL);
+    steps = bgpreset_fill_spaces(game);
+    NKPROF_STOP(NKPROF_FILL);
+    return steps;
 }
 
-void bggame_animate_space_fill(game_t *game) {
-    uint8_t spaces = 1, move = 0;
-    while(spaces) {
-        if (nktimer_animate()) {
-            if(move > 7) {
-                move = 0;
-                spaces = bggame_fill_spaces(game);
-                bggame_write_board(*game);
-            } else
-                move++;
+// refill the board, and prepare to animate the refill: each step
+// of the animation removes the leftmost remaining space from each
+// row, and adds the next new piece on the right
+void bggame_fill_start(game_t *game, fill_t *fill) {
+    int8_t r;
+    // spaces are piece type 0
+    bgbits_piece_rows(game, 0, fill->spaces);
+    bggame_read_rows(game, fill->frame);
+    for (r = 0; r < game->height; r++)
+        fill->count[r] = bgbits_count(fill->spaces[r]);
+    fill->step = 0;
+    fill->steps = bggame_fill_spaces(game);
+    fill->game = game;
+}
+
+// advance the animation frame by one refill step
+// returns true if there are more steps to come
+uint8_t bggame_fill_step(const game_t *game, fill_t *fill) {
+    int8_t r, c;
+    bgbits_row_t bits;
+    for (r = 0; r < game->height; r++) {
+        if (fill->step < fill->count[r]) {
+            // the leftmost space left in the original row is the
+            // lowest bit left in the mask, and the pieces before it
+            // have already slid left once per step
+            for (c = 0, bits = fill->spaces[r]; !(bits & 1); c++)
+                bits >>= 1;
+            fill->spaces[r] &= fill->spaces[r]-1;
+            bggame_shift(fill->frame[r], game->width, c-fill->step);
+            fill->frame[r][game->width-1] = bggame_piece(
+                game, r, game->width-fill->count[r]+fill->step);
         }
     }
+    return ++fill->step < fill->steps;
+}
+
+// show one step of the fill, every ninth tick
+int16_t bggame_fill_task(void *state) {
+    fill_t *fill = (fill_t*)state;
+    uint8_t spaces = bggame_fill_step(fill->game, fill);
+    nklcd_write_grid(&fill->frame[0][0], MAX_WIDTH,
+                     fill->game->height, fill->game->width);
+    return spaces ? BGGAME_FILL_TICKS : 0;
+}
+
+void bggame_animate_space_fill(game_t *game) {
+    fill_t fill;
+    bggame_fill_start(game, &fill);
+    if (fill.steps > 0)
+        nktimer_run(bggame_fill_task, &fill, BGGAME_FILL_TICKS);
 }
 
 void bggame_animate_clear_sets(game_t *game) {
@@ -259,106 +350,190 @@ void bggame_animate_clear_sets(game_t *game) {
     do {
         game->score += (combos * bggame_remove_sets(game));
         combos++;
-        bggame_write_board(*game);
+        bggame_write_board(game);
         bggame_animate_space_fill(game);
     } while (bggame_mark_sets(game));
 }
 
 void bggame_clear_marks(game_t *game) {
-    int8_t r, c;
-    for (r = 0; r < game->height; r++)
-        for (c = 0; c < game->width; c++)
-            game->board[r][c] |= 0x20;
+    int8_t r;
+    for (r = 0; r < MAX_HEIGHT; r++)
+        game->marks[r] = 0;
 }
 
-uint8_t bggame_valid_move(game_t game, point_t a, point_t b) {
-    uint8_t valid = 0;
-    bggame_swap_pieces(&game, a, b);
-    if (bggame_mark_sets(&game)) {
-        valid = 1;
-        bggame_clear_marks(&game);
-    }
-    bggame_swap_pieces(&game, a, b);
-    return valid;
-}
-
-uint8_t bggame_valid_move_exists(game_t game) {
-    point_t check, right, below;
-    uint8_t valid = 0;
-    for (check.row = 0, right.row = 0, below.row = 1;
-         check.row < game.height;
-         check.row++, right.row++,
-             below.row=bggame_next_row(game, below.row)) {
-        for (check.column = 0, right.column = 1, below.column = 0;
-             !valid && check.column < game.width;
-             check.column++,
-                 right.column=bggame_next_column(game, right.column),
-                 below.column++) {
-            valid = bggame_valid_move(game, check, right) ||
-                bggame_valid_move(game, check, below);
-        }
-    }
-    return valid;
+// return the index i steps away from rc, wrapping within max
+int8_t bggame_wrap(int8_t rc, int8_t i, int8_t max) {
+    rc += i;
+    if (rc < 0) return rc+max;
+    if (rc >= max) return rc-max;
+    return rc;
 }
 
-void bggame_play(game_t *game) {
+// return the piece that would be at row r, column c
+// if the pieces at a and b were swapped
+char bggame_swapped_piece(const game_t *game,
+                          point_t a,
+                          point_t b,
+                          int8_t r,
+                          int8_t c) {
+    if (r == a.row && c == a.column)
+        return bggame_piece(game, b.row, b.column);
+    if (r == b.row && c == b.column)
+        return bggame_piece(game, a.row, a.column);
+    return bggame_piece(game, r, c);
+}
+
+// determine if swapping a and b would make a set that includes p
+// (only the two cells on either side of p, in each direction, can)
+uint8_t bggame_swap_makes_set(const game_t *game,
+                              point_t a,
+                              point_t b,
+                              point_t p) {
+    char line[5];
+    int8_t i;
+
+    // the five cells centred on p, across and then down
+    for (i = 0; i < 5; i++)
+        line[i] = bggame_swapped_piece(
+            game, a, b, p.row, bggame_wrap(p.column, i-2, game->width));
+    if (bggame_match(line[0], line[1], line[2]) ||
+        bggame_match(line[1], line[2], line[3]) ||
+        bggame_match(line[2], line[3], line[4]))
+        return 1;
+
+    for (i = 0; i < 5; i++)
+        line[i] = bggame_swapped_piece(
+            game, a, b, bggame_wrap(p.row, i-2, game->height), p.column);
+    return (bggame_match(line[0], line[1], line[2]) ||
+            bggame_match(line[1], line[2], line[3]) ||
+            bggame_match(line[2], line[3], line[4]));
+}
+
+// determine if swapping a and b would make a set, without
+// modifying (or marking) the board
+uint8_t bggame_valid_move(const game_t *game, point_t a, point_t b) {
+    return bggame_swap_makes_set(game, a, b, a) ||
+        bggame_swap_makes_set(game, a, b, b);
+}
+
+uint8_t bggame_valid_move_exists(const game_t *game) {
+    uint8_t exists;
+    NKPROF_START(NKPROF_VALID_MOVE);
+    exists = bgpreset_valid_move_exists(game);
+    NKPROF_STOP(NKPROF_VALID_MOVE);
+    return exists;
+}
+
+// a game's state between ticks
+typedef struct {
+    game_t *game;
     // row and column of the cursor
     point_t cursor;
     // read state
     nkbuttons_t button_state;
-    // latest new presses
-    uint8_t pressed_buttons;
     // selection state
     point_t selection;
-    // idle/sleep timer
-    int16_t idle = 0;
-
-    nkbuttons_clear(&button_state);
-    cursor.row = 0;
-    cursor.column = 0;
-    bggame_invalidate_selection(&selection);
-
-    bggame_board_init(game);
-    lcd_clear_and_home();
-    bggame_animate_clear_sets(game);
-    game->score = 0; // no points for tiles removed before play starts
-    lcd_goto_position(cursor.row, cursor.column);
-    nklcd_start_blinking();
-    uint8_t move_exists = bggame_valid_move_exists(*game);
-    // now let play begin
-    while(move_exists) {
-        if (nktimer_animate()) {
-            pressed_buttons = nkbuttons_read(&button_state);
-
-            if(pressed_buttons) {
-                idle = 0;
-                nklcd_stop_blinking();
-                bggame_move_cursor(*game, pressed_buttons, &cursor);
-                if(bggame_select(game, pressed_buttons, cursor, &selection)) {
-                    bggame_animate_clear_sets(game);
-                    move_exists = bggame_valid_move_exists(*game);
-                }
-                lcd_goto_position(cursor.row, cursor.column);
-                nklcd_start_blinking();
-            } else if (++idle > 3600) {
-                // go to sleep after a minute of no activity
-                idle = 0;
-                nksleep_standby();
-                // display comes out of standby with blink disabled
-                nklcd_start_blinking();
+    // the tick of the last press, for the idle/sleep timer
+    uint16_t active;
+    // whether this tick had a press (the hint waits for one without)
+    uint8_t pressed;
+    uint8_t move_exists;
+    // best move, searched for while idle
+    bghint_t hint;
+} play_t;
+
+// handle one tick's presses; finished when no move is left
+int16_t bggame_play_task(void *state) {
+    play_t *play = (play_t*)state;
+    game_t *game = play->game;
+    uint8_t pressed_buttons = nkbuttons_read(&play->button_state);
+
+    play->pressed = pressed_buttons != 0;
+    if(pressed_buttons) {
+        play->active = nktimer_now();
+        nklcd_stop_blinking();
+        if ((play->button_state.stable & BGHINT_BUTTONS) ==
+            BGHINT_BUTTONS) {
+            // show the best move found so far: select one piece
+            // of the swap, and put the cursor on the other, so
+            // that Select makes the move
+            if (play->hint.score) {
+                if (bggame_selection_is_active(play->selection))
+                    bggame_clear_selection(game, &play->selection);
+                bggame_set_selection(game, &play->selection,
+                                     play->hint.a);
+                play->cursor.row = play->hint.b.row;
+                play->cursor.column = play->hint.b.column;
+            }
+        } else {
+            bggame_move_cursor(game, pressed_buttons, &play->cursor);
+            if(bggame_select(game, pressed_buttons,
+                             play->cursor, &play->selection)) {
+                bggame_animate_clear_sets(game);
+                play->move_exists = bggame_valid_move_exists(game);
+                bghint_reset(&play->hint);
             }
         }
+        nklcd_goto_position(play->cursor.row, play->cursor.column);
+        nklcd_start_blinking();
+    } else if ((uint16_t)(nktimer_now() - play->active) > 3600) {
+        // go to sleep after a minute of no activity
+        nksleep_standby();
+        play->active = nktimer_now();
+        // display comes out of standby with blink disabled
+        nklcd_start_blinking();
+    }
+    return play->move_exists;
+}
+
+// use the spare time in each tick without a press to look for a hint
+int16_t bggame_hint_task(void *state) {
+    play_t *play = (play_t*)state;
+    if (!play->pressed)
+        bghint_step(play->game, &play->hint, BGHINT_CELLS);
+    return 1;
+}
+
+void bggame_play(game_t *game) {
+    play_t play;
+    int8_t hint;
+
+    play.game = game;
+    nkbuttons_clear(&play.button_state);
+    play.cursor.row = 0;
+    play.cursor.column = 0;
+    bggame_invalidate_selection(&play.selection);
+    play.pressed = 0;
+
+    bggame_deal(game);
+    game->score = 0;
+    nklcd_clear();
+    bggame_write_board(game);
+    nklcd_goto_position(play.cursor.row, play.cursor.column);
+    nklcd_start_blinking();
+    play.move_exists = bggame_valid_move_exists(game);
+    bghint_reset(&play.hint);
+    // now let play begin, with the hint search running beside it
+    nktimer_screen(NKTIMER_GAME);
+    play.active = nktimer_now();
+    if (play.move_exists) {
+        hint = nktimer_add(bggame_hint_task, &play, 1);
+        nktimer_run(bggame_play_task, &play, 1);
+        nktimer_remove(hint);
     }
 }
 
 void bggame_over(uint16_t score) {
     // game is over (no more moves)
     nklcd_stop_blinking();
-    lcd_clear_and_home();
-    lcd_goto_position(0, 6);
-    lcd_write_string(PSTR("GAME OVER"));
-    lcd_goto_position(2, 4);
-    lcd_write_string(PSTR("score: "));
-    lcd_write_int16(score);
+    nklcd_clear();
+    nklcd_goto_position(0, 6);
+    nklcd_write_string(PSTR("GAME OVER"));
+    nklcd_goto_position(2, 4);
+    nklcd_write_string(PSTR("score: "));
+    nklcd_write_int16(score);
+    // start timing once the screen is all there
+    nklcd_flush();
+    nktimer_screen(NKTIMER_OVER);
     nktimer_simple_delay(300);
 }
@@ -9,22 +9,61 @@
 #include <avr/pgmspace.h>
 #include <avr/interrupt.h>
 
-#include "lcd.h"
-
 #include "nkbuttons.h"
 #include "nkeeprom.h"
 #include "nklcd.h"
+#include "nkrand.h"
 #include "nktimer.h"
+#include "nkprof.h"
 
+#include "bggame.h"
 #include "bghighscore.h"
 
+// the table for the board configuration in bghighscore_key
 bghighscore_t highscores[HIGH_SCORES];
+uint16_t bghighscore_key;
+// where each configuration's table is kept
+nkeeprom_tables_t bghighscore_tables;
 
-void bghighscore_init() {
-    if (!bghighscore_read()) {
-        bghighscore_clear();
-        bghighscore_write();
+// find the table store, or make one (interrupts must be enabled)
+void bghighscore_init(const game_t *game) {
+    nkeeprom_tables_init(&bghighscore_tables,
+                         BGHIGHSCORE_TABLES,
+                         BGHIGHSCORE_VERSION,
+                         BGHIGHSCORE_SLOTS,
+                         BGHIGHSCORE_BYTES);
+    bghighscore_key = BGHIGHSCORE_KEY(game->width,
+                                      game->height,
+                                      game->variety);
+    if (nkeeprom_tables_formatted(&bghighscore_tables) ||
+        nkeeprom_tables_recover(&bghighscore_tables)) {
+        if (!bghighscore_read())
+            bghighscore_clear();
+    } else {
+        bghighscore_migrate();
+    }
+}
+
+// before the store, every board shared one table; it carries over as
+// the table for the board the game starts with, and the store only
+// covers the old copy once the carried-over table is safe in it
+void bghighscore_migrate() {
+    uint16_t from;
+    if (bghighscore_read_ring(&from)) {
+        nkeeprom_tables_migrate(&bghighscore_tables,
+                                bghighscore_key,
+                                (unsigned char*)&highscores,
+                                from,
+                                from+BGHIGHSCORE_BYTES+2);
+        return;
     }
+    if (!bghighscore_read_legacy())
+        bghighscore_clear();
+    nkeeprom_tables_migrate(&bghighscore_tables,
+                            bghighscore_key,
+                            (unsigned char*)&highscores,
+                            BGHIGHSCORE_LEGACY,
+                            BGHIGHSCORE_RING);
 }
 
 uint8_t bghighscore_checksum() {
@@ -35,22 +74,63 @@ uint8_t bghighscore_checksum() {
     return x;
 }
 
-uint8_t bghighscore_read() {
-    uint8_t x, s, c;
-    cli(); // disable interrupts
-    nkeeprom_read_bytes((unsigned char*)&highscores,
-                        0,
-                        HIGH_SCORES*sizeof(bghighscore_t));
-    nkeeprom_read_bytes(&x,
-                        HIGH_SCORES*sizeof(bghighscore_t),
-                        1);
-    sei();
+// return true if every initial in the table is a letter
+uint8_t bghighscore_valid() {
+    uint8_t s, c;
     for (s = 0; s < HIGH_SCORES; s++)
         for (c = 0; c < INITIALS; c++)
             if (highscores[s].initials[c] < 'a' ||
                 highscores[s].initials[c] > 'z')
                 return 0;
-    return x == bghighscore_checksum();
+    return 1;
+}
+
+// read the table from where it was kept before the ring
+uint8_t bghighscore_read_legacy() {
+    uint8_t x;
+    nkeeprom_read_bytes((unsigned char*)&highscores,
+                        BGHIGHSCORE_LEGACY,
+                        BGHIGHSCORE_BYTES);
+    nkeeprom_read_bytes(&x,
+                        BGHIGHSCORE_LEGACY+BGHIGHSCORE_BYTES,
+                        1);
+    return bghighscore_valid() && x == bghighscore_checksum();
+}
+
+// read the newest shared table from the ring that replaced the
+// legacy copy, and say where its record is
+uint8_t bghighscore_read_ring(uint16_t *address) {
+    nkeeprom_ring_t ring;
+    nkeeprom_ring_init(&ring,
+                       BGHIGHSCORE_RING,
+                       BGHIGHSCORE_RING_SLOTS,
+                       BGHIGHSCORE_BYTES);
+    if (!nkeeprom_ring_read(&ring, (unsigned char*)&highscores) ||
+        !bghighscore_valid())
+        return 0;
+    *address = nkeeprom_ring_address(&ring, ring.newest);
+    return 1;
+}
+
+// read the table for bghighscore_key from the store
+uint8_t bghighscore_read() {
+    return nkeeprom_tables_read(&bghighscore_tables,
+                                bghighscore_key,
+                                (unsigned char*)&highscores) &&
+        bghighscore_valid();
+}
+
+// switch to the table for a board configuration
+// (an empty one, if that board has no saved scores)
+void bghighscore_load(const game_t *game) {
+    uint16_t key = BGHIGHSCORE_KEY(game->width,
+                                   game->height,
+                                   game->variety);
+    if (key == bghighscore_key)
+        return;
+    bghighscore_key = key;
+    if (!bghighscore_read())
+        bghighscore_clear();
 }
 
 void bghighscore_clear() {
@@ -62,39 +142,81 @@ void bghighscore_clear() {
     }
 }
 
+// the save finishes in the background, long before the table can
+// change again at the end of the next game
 void bghighscore_write() {
-    uint8_t x = bghighscore_checksum();
-    cli(); //disable interrupts
-    nkeeprom_write_bytes((unsigned char *)&highscores,
-                         0,
-                         HIGH_SCORES*sizeof(bghighscore_t));
-    nkeeprom_write_bytes((unsigned char *)&x,
-                         HIGH_SCORES*sizeof(bghighscore_t),
-                         1);
-    sei();
+    nkeeprom_tables_write(&bghighscore_tables,
+                          bghighscore_key,
+                          (unsigned char *)&highscores);
 }
 
 void bghighscore_display_line(int8_t rank, int8_t lcd_line) {
     int8_t c;
-    lcd_goto_position(lcd_line, 6);
+    nklcd_goto_position(lcd_line, 6);
     for (c = 0; c < INITIALS; c++)
-        lcd_write_data(highscores[rank].initials[c]);
-    lcd_write_byte(' ');
-    lcd_write_int16(highscores[rank].score);
+        nklcd_write_data(highscores[rank].initials[c]);
+    nklcd_write_data(' ');
+    nklcd_write_int16(highscores[rank].score);
 }
 
 void bghighscore_screen() {
     int8_t s;
     // game is over (no more moves)
-    lcd_clear_and_home();
+    nklcd_clear();
     nklcd_stop_blinking();
-    lcd_goto_position(0, 5);
-    lcd_write_string(PSTR("HIGH SCORES"));
+    nklcd_goto_position(0, 1);
+    nklcd_write_string(PSTR("HIGH SCORES "));
+    // which board these are for, as width x height : variety
+    nklcd_write_int16(BGHIGHSCORE_KEY_WIDTH(bghighscore_key));
+    nklcd_write_data('x');
+    nklcd_write_int16(BGHIGHSCORE_KEY_HEIGHT(bghighscore_key));
+    nklcd_write_data(':');
+    nklcd_write_int16(BGHIGHSCORE_KEY_VARIETY(bghighscore_key));
     for (s = 0; s < HIGH_SCORES; s++) {
         bghighscore_display_line(s, 1+s);
     }
 
-    nktimer_simple_delay(300);
+    nklcd_flush();
+    nktimer_screen(NKTIMER_HIGHSCORE);
+    bghighscore_delay(300);
+}
+
+#ifdef NKPROF
+// a wait for bghighscore_delay
+typedef struct {
+    int16_t clicks;
+    nkbuttons_t button_state;
+    // whether NKPROF_CHORD ended the wait
+    uint8_t chord;
+} bghighscore_delay_t;
+
+int16_t bghighscore_delay_task(void *state) {
+    bghighscore_delay_t *delay = (bghighscore_delay_t*)state;
+    if (nkbuttons_read(&delay->button_state) & B_SELECT)
+        return 0;
+    if ((delay->button_state.stable & NKPROF_CHORD) == NKPROF_CHORD) {
+        delay->chord = 1;
+        return 0;
+    }
+    return --delay->clicks > 0;
+}
+#endif
+
+// wait as nktimer_simple_delay does, but with NKPROF_CHORD held down,
+// show the profiler's totals instead
+void bghighscore_delay(int16_t clicks) {
+#ifdef NKPROF
+    bghighscore_delay_t delay;
+    delay.clicks = clicks;
+    delay.chord = 0;
+    nkbuttons_clear(&delay.button_state);
+    if (clicks > 0)
+        nktimer_run(bghighscore_delay_task, &delay, 1);
+    if (delay.chord)
+        nkprof_screen();
+#else
+    nktimer_simple_delay(clicks);
+#endif
 }
 
 void alter_highscore_initials(uint8_t buttons, int8_t rank, int8_t i) {
@@ -133,38 +255,50 @@ uint8_t bghighscore_move_cursor(uint8_t buttons, int8_t *i) {
     return 0;
 }
 
+// the initials being entered for a new high score
+typedef struct {
+    nkbuttons_t button_state;
+    int8_t rank;
+    // the initial under the cursor
+    int8_t i;
+} bghighscore_entry_t;
+
+// handle one tick's presses; finished when the initials are confirmed
+int16_t bghighscore_new_task(void *state) {
+    bghighscore_entry_t *entry = (bghighscore_entry_t*)state;
+    uint8_t pressed_buttons = nkbuttons_read(&entry->button_state);
+
+    if(pressed_buttons) {
+        nklcd_stop_blinking();
+        alter_highscore_initials(pressed_buttons, entry->rank, entry->i);
+        if(bghighscore_move_cursor(pressed_buttons, &entry->i))
+            return 0;
+        bghighscore_display_line(entry->rank, 2);
+        nklcd_goto_position(2, 6+entry->i);
+        nklcd_start_blinking();
+    }
+    return 1;
+}
+
 void bghighscore_new(int8_t rank, uint16_t score) {
+    bghighscore_entry_t entry;
     int8_t i;
-    nkbuttons_t button_state;
-    uint8_t pressed_buttons;
-    nkbuttons_clear(&button_state);
+    nkbuttons_clear(&entry.button_state);
     for (i = 0; i < INITIALS; i++)
         highscores[rank].initials[i] = 'a';
     highscores[rank].score = score;
 
-    lcd_clear_and_home();
-    lcd_goto_position(0, 2);
-    lcd_write_string(PSTR("NEW HIGH SCORE"));
+    nklcd_clear();
+    nklcd_goto_position(0, 2);
+    nklcd_write_string(PSTR("NEW HIGH SCORE"));
     bghighscore_display_line(rank, 2);
-    lcd_goto_position(2, 6);
+    nklcd_goto_position(2, 6);
     nklcd_start_blinking();
-    i = 0;
-
-    while(1) {
-        if (nktimer_animate()) {
-            pressed_buttons = nkbuttons_read(&button_state);
-
-            if(pressed_buttons) {
-                nklcd_stop_blinking();
-                alter_highscore_initials(pressed_buttons, rank, i);
-                if(bghighscore_move_cursor(pressed_buttons, &i))
-                    break;
-                bghighscore_display_line(rank, 2);
-                lcd_goto_position(2, 6+i);
-                nklcd_start_blinking();
-            }
-        }
-    }
+    entry.rank = rank;
+    entry.i = 0;
+
+    nktimer_screen(NKTIMER_HIGHSCORE);
+    nktimer_run(bghighscore_new_task, &entry, 1);
 
     bghighscore_write();
 }
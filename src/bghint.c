@@ -0,0 +1,84 @@
+// blockgame
+// for NerdKits with ATmega168
+// copyright 2011 Bryan Fink
+// license: see LICENSE.txt
+
+// finding the best move while the player is idle
+
+#include <inttypes.h>
+
+#include "nkrand.h"
+
+#include "bggame.h"
+#include "bghint.h"
+
+// start a new search (the board has changed)
+void bghint_reset(bghint_t *hint) {
+    hint->next.row = 0;
+    hint->next.column = 0;
+    hint->next.meta = 0;
+    hint->score = 0;
+}
+
+// return true if every swap on the board has been scored
+uint8_t bghint_done(const game_t *game, const bghint_t *hint) {
+    return hint->next.row >= game->height;
+}
+
+// score a swap by the pieces it removes right away, plus the
+// number of cascades that follow from the pieces already on the
+// board (the pieces that will be added are unknown, so they are
+// left as spaces, which never make sets)
+uint8_t bghint_score(const game_t *game, point_t a, point_t b) {
+    game_t play;
+    int8_t r;
+    uint8_t score;
+
+    if (!bggame_valid_move(game, a, b))
+        return 0;
+
+    play = *game;
+    bggame_swap_pieces(&play, a, b);
+    bggame_mark_sets(&play);
+    score = bggame_remove_sets(&play);
+    while (1) {
+        for (r = 0; r < play.height; r++)
+            bggame_compact_row(&play, r, play.width);
+        if (!bggame_mark_sets(&play))
+            break;
+        bggame_remove_sets(&play);
+        score++;
+    }
+    return score;
+}
+
+// keep the swap of a and b if it beats the best so far
+void bghint_consider(const game_t *game,
+                     bghint_t *hint,
+                     point_t a,
+                     point_t b) {
+    uint8_t score = bghint_score(game, a, b);
+    if (score > hint->score) {
+        hint->score = score;
+        hint->a = a;
+        hint->b = b;
+    }
+}
+
+// score the swaps of up to the given number of cells, picking up
+// where the last step left off
+void bghint_step(const game_t *game, bghint_t *hint, int8_t cells) {
+    point_t right, below;
+    for (; cells > 0 && !bghint_done(game, hint); cells--) {
+        right = below = hint->next;
+        right.column = bggame_next_column(game, hint->next.column);
+        below.row = bggame_next_row(game, hint->next.row);
+        bghint_consider(game, hint, hint->next, right);
+        bghint_consider(game, hint, hint->next, below);
+
+        if (++hint->next.column >= game->width) {
+            hint->next.column = 0;
+            hint->next.row++;
+        }
+    }
+}
@@ -8,10 +8,9 @@
 #include <inttypes.h>
 #include <avr/pgmspace.h>
 
-#include "lcd.h"
-
 #include "nkbuttons.h"
 #include "nklcd.h"
+#include "nkrand.h"
 #include "nktimer.h"
 
 #include "bggame.h"
@@ -25,10 +24,10 @@
 #define P_LAST    3
 
 void bgmenu_forb(int8_t row, uint8_t focus) {
-    lcd_goto_position(row, 10);
-    lcd_write_data(focus ? 0x7e : ' ');
-    lcd_goto_position(row, 16);
-    lcd_write_data(focus ? 0x7f : ' ');
+    nklcd_goto_position(row, 10);
+    nklcd_write_data(focus ? 0x7e : ' ');
+    nklcd_goto_position(row, 16);
+    nklcd_write_data(focus ? 0x7f : ' ');
 }
 void bgmenu_focus(int8_t row) {
     bgmenu_forb(row, 1);
@@ -38,10 +37,10 @@ void bgmenu_blur(int8_t row) {
 }
 
 void bgmenu_write_prompt(int8_t row, int8_t val) {
-    lcd_goto_position(row, 12);
+    nklcd_goto_position(row, 12);
     if (val < 10)
-        lcd_write_data(' ');
-    lcd_write_int16(val);
+        nklcd_write_data(' ');
+    nklcd_write_int16(val);
 }
 
 int8_t bgmenu_previous_prompt(int8_t current) {
@@ -74,7 +73,7 @@ int8_t bgmenu_field_and_limits(int8_t prompt, game_t *game,
     case P_VARIETY:
         *field = &game->variety;
         *min = 5;
-        *max = 26;
+        *max = BGGAME_MAX_VARIETY;
         return 1;
     default:
         return 0; // start doesn't increase
@@ -99,53 +98,68 @@ void bgmenu_decrease_prompt(int8_t prompt, game_t *game) {
     }
 }
 
-uint8_t bgmenu_display(game_t *game) {
-    uint8_t ready = 0;
-    int8_t prompt = 0;
-    int16_t inactivity = 0;
-    uint8_t pressed_buttons;
+// the menu's state between ticks
+typedef struct {
+    game_t *game;
     nkbuttons_t button_state;
-    nkbuttons_clear(&button_state);
+    int8_t prompt;
+    // the tick of the last press
+    uint16_t active;
+    uint8_t ready;
+} bgmenu_t;
+
+// handle one tick's presses; finished when start is chosen, or after
+// 10sec without a press (to show the "screen saver")
+int16_t bgmenu_task(void *state) {
+    bgmenu_t *menu = (bgmenu_t*)state;
+    uint8_t pressed_buttons = nkbuttons_read(&menu->button_state);
+    if(pressed_buttons) {
+        menu->active = nktimer_now();
+        if (pressed_buttons & B_SELECT && menu->prompt == P_START) {
+            menu->ready = 1;
+            return 0;
+        } else if (pressed_buttons & B_UP) {
+            menu->prompt = bgmenu_previous_prompt(menu->prompt);
+        } else if (pressed_buttons & (B_DOWN | B_SELECT)) {
+            menu->prompt = bgmenu_next_prompt(menu->prompt);
+        } else if (pressed_buttons & B_LEFT) {
+            bgmenu_decrease_prompt(menu->prompt, menu->game);
+        } else {
+            bgmenu_increase_prompt(menu->prompt, menu->game);
+        }
+    } else if ((uint16_t)(nktimer_now() - menu->active) > 600) {
+        return 0;
+    }
+    return 1;
+}
+
+uint8_t bgmenu_display(game_t *game) {
+    bgmenu_t menu;
+    menu.game = game;
+    menu.prompt = 0;
+    menu.ready = 0;
+    nkbuttons_clear(&menu.button_state);
     nklcd_stop_blinking();
-    lcd_clear_and_home();
+    nklcd_clear();
 
-    lcd_goto_position(P_WIDTH, 3);
-    lcd_write_string(PSTR("width:"));
+    nklcd_goto_position(P_WIDTH, 3);
+    nklcd_write_string(PSTR("width:"));
     bgmenu_write_prompt(P_WIDTH, game->width);
     bgmenu_focus(P_WIDTH);
 
-    lcd_goto_position(P_HEIGHT, 2);
-    lcd_write_string(PSTR("height:"));
+    nklcd_goto_position(P_HEIGHT, 2);
+    nklcd_write_string(PSTR("height:"));
     bgmenu_write_prompt(P_HEIGHT, game->height);
 
-    lcd_goto_position(P_VARIETY, 1);
-    lcd_write_string(PSTR("variety:"));
+    nklcd_goto_position(P_VARIETY, 1);
+    nklcd_write_string(PSTR("variety:"));
     bgmenu_write_prompt(P_VARIETY, game->variety);
 
-    lcd_goto_position(P_START, 11);
-    lcd_write_string(PSTR("start"));
-
-    while(!ready) {
-        if (nktimer_animate()) {
-            pressed_buttons = nkbuttons_read(&button_state);
-            if(pressed_buttons) {
-                inactivity = 0;
-                if (pressed_buttons & B_SELECT && prompt == P_START) {
-                    ready = 1;
-                } else if (pressed_buttons & B_UP) {
-                    prompt = bgmenu_previous_prompt(prompt);
-                } else if (pressed_buttons & (B_DOWN | B_SELECT)) {
-                    prompt = bgmenu_next_prompt(prompt);
-                } else if (pressed_buttons & B_LEFT) {
-                    bgmenu_decrease_prompt(prompt, game);
-                } else {
-                    bgmenu_increase_prompt(prompt, game);
-                }
-            } else if (++inactivity > 600) {
-                return 0; // leave menu for "screen saver" after 10sec
-            }
-        }
-    }
-    return 1;
-}
+    nklcd_goto_position(P_START, 11);
+    nklcd_write_string(PSTR("start"));
 
+    nktimer_screen(NKTIMER_MENU);
+    menu.active = nktimer_now();
+    nktimer_run(bgmenu_task, &menu, 1);
+    return menu.ready;
+}
@@ -0,0 +1,93 @@
+// blockgame
+// for NerdKits with ATmega168
+// copyright 2011 Bryan Fink
+// license: see LICENSE.txt
+
+// finding vertical sets a whole column at a time, with each column's
+// pieces packed into one word (SIMD within a register)
+
+#include <inttypes.h>
+
+#include "nkrand.h"
+
+#include "bggame.h"
+#include "bgpack.h"
+
+// work out the masks for columns of the given height
+void bgpack_shape(bgpack_shape_t *shape, int8_t height) {
+    int8_t r;
+    shape->low = shape->high = shape->full = 0;
+    for (r = 0; r < height; r++) {
+        shape->low = (shape->low << BGPACK_BITS) | 0x0F;
+        shape->high = (shape->high << BGPACK_BITS) | 0x10;
+        shape->full = (shape->full << BGPACK_BITS) | BGPACK_MASK;
+    }
+    shape->bottom = BGPACK_BITS*(height-1);
+}
+
+// pack column c of the board
+bgpack_column_t bgpack_column(const game_t *game, int8_t c) {
+    bgpack_column_t column = 0;
+    int8_t r;
+    // walk upward so each row can be shifted in from the top
+    for (r = game->height-1; r >= 0; r--)
+        column = (column << BGPACK_BITS) | bggame_type(game, r, c);
+    return column;
+}
+
+// rotate a column one row up the board (row r+1 moves to r),
+// wrapping row 0 around to the bottom
+bgpack_column_t bgpack_down(bgpack_column_t column,
+                            const bgpack_shape_t *shape) {
+    return (column >> BGPACK_BITS) |
+        ((column & BGPACK_MASK) << shape->bottom);
+}
+
+// rotate a column one row down the board (row r moves to r+1),
+// wrapping the bottom row around to row 0
+bgpack_column_t bgpack_up(bgpack_column_t column,
+                          const bgpack_shape_t *shape) {
+    return ((column << BGPACK_BITS) & shape->full) |
+        (column >> shape->bottom);
+}
+
+// set the top bit of each row's field that is not zero
+bgpack_column_t bgpack_nonzero(bgpack_column_t x,
+                               const bgpack_shape_t *shape) {
+    // adding 0xF to a field's low four bits carries into its top bit
+    // if any of them are set, and can't carry out of the field
+    return (((x & shape->low) + shape->low) | x) & shape->high;
+}
+
+// find the vertical sets in a packed column; returns the top bit of
+// each row's field set if that row's piece is in a set
+bgpack_column_t bgpack_column_sets(bgpack_column_t column,
+                                   const bgpack_shape_t *shape) {
+    bgpack_column_t next = bgpack_down(column, shape);
+    bgpack_column_t differ, start;
+    // a set starts at each row whose piece is not a space, and
+    // matches the pieces in the next two rows
+    differ = (column ^ next) | (column ^ bgpack_down(next, shape));
+    start = bgpack_nonzero(column, shape) & ~bgpack_nonzero(differ, shape);
+    if (!start)
+        return 0;
+    // and also covers those next two rows
+    next = bgpack_up(start, shape);
+    return start | next | bgpack_up(next, shape);
+}
+
+// add the board's vertical sets to marks
+// (columns wrap, so on boards shorter than three rows a set reuses
+// rows, as it does for the bitboard rows in bgpreset.inc)
+void bgpack_vertical_sets(const game_t *game, bgbits_row_t *marks) {
+    bgpack_shape_t shape;
+    bgpack_column_t sets;
+    int8_t r, c;
+    bgpack_shape(&shape, game->height);
+    for (c = 0; c < game->width; c++) {
+        sets = bgpack_column_sets(bgpack_column(game, c), &shape);
+        for (r = 0; sets; r++, sets >>= BGPACK_BITS)
+            if (sets & 0x10)
+                marks[r] |= (bgbits_row_t)1 << c;
+    }
+}
@@ -0,0 +1,91 @@
+// blockgame
+// for NerdKits with ATmega168
+// copyright 2011 Bryan Fink
+// license: see LICENSE.txt
+
+// picking the copy of the board routines built for a board's size
+
+#include <inttypes.h>
+#include <avr/pgmspace.h>
+
+#include "nkrand.h"
+
+#include "bggame.h"
+#include "bgbits.h"
+#include "bgpack.h"
+#include "bgpreset.h"
+
+// index i, stepped up to two cells off either end of a row or
+// column n long, wrapped back onto it
+#define BGPRESET_WRAP(i, n) ((i) < 0 ? (i)+(n) : (i) >= (n) ? (i)-(n) : (i))
+// true if cells i, i+1 and i+2 of a line hold the same type
+#define BGPRESET_MATCH(line, i) \
+    ((line)[i] == (line)[(i)+1] && (line)[i] == (line)[(i)+2])
+
+// the copy for any size
+#define BGPRESET(name) bgpreset_##name##_any
+#define BGPRESET_WIDTH (game->width)
+#define BGPRESET_HEIGHT (game->height)
+#include "bgpreset.inc"
+#undef BGPRESET
+#undef BGPRESET_WIDTH
+#undef BGPRESET_HEIGHT
+
+#ifdef BGPRESET_20X4
+#define BGPRESET(name) bgpreset_##name##_20x4
+#define BGPRESET_WIDTH 20
+#define BGPRESET_HEIGHT 4
+#include "bgpreset.inc"
+#undef BGPRESET
+#undef BGPRESET_WIDTH
+#undef BGPRESET_HEIGHT
+#endif
+
+#ifdef BGPRESET_10X3
+#define BGPRESET(name) bgpreset_##name##_10x3
+#define BGPRESET_WIDTH 10
+#define BGPRESET_HEIGHT 3
+#include "bgpreset.inc"
+#undef BGPRESET
+#undef BGPRESET_WIDTH
+#undef BGPRESET_HEIGHT
+#endif
+
+// true if the game's board is the given size
+#define BGPRESET_IS(game, w, h) ((game)->width == (w) && (game)->height == (h))
+
+uint8_t bgpreset_find_sets(const game_t *game, bgbits_row_t *marks) {
+#ifdef BGPRESET_20X4
+    if (BGPRESET_IS(game, 20, 4))
+        return bgpreset_find_sets_20x4(game, marks);
+#endif
+#ifdef BGPRESET_10X3
+    if (BGPRESET_IS(game, 10, 3))
+        return bgpreset_find_sets_10x3(game, marks);
+#endif
+    return bgpreset_find_sets_any(game, marks);
+}
+
+uint8_t bgpreset_valid_move_exists(const game_t *game) {
+#ifdef BGPRESET_20X4
+    if (BGPRESET_IS(game, 20, 4))
+        return bgpreset_valid_move_exists_20x4(game);
+#endif
+#ifdef BGPRESET_10X3
+    if (BGPRESET_IS(game, 10, 3))
+        return bgpreset_valid_move_exists_10x3(game);
+#endif
+    return bgpreset_valid_move_exists_any(game);
+}
+
+uint8_t bgpreset_fill_spaces(game_t *game) {
+#ifdef BGPRESET_20X4
+    if (BGPRESET_IS(game, 20, 4))
+        return bgpreset_fill_spaces_20x4(game);
+#endif
+#ifdef BGPRESET_10X3
+    if (BGPRESET_IS(game, 10, 3))
+        return bgpreset_fill_spaces_10x3(game);
+#endif
+    return bgpreset_fill_spaces_any(game);
+}
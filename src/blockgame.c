@@ -3,7 +3,6 @@
 // copyright 2011 Bryan Fink
 // license: see LICENSE.txt
 
-#include <stdlib.h>
 #include <inttypes.h>
 
 #include <avr/pgmspace.h>
@@ -16,6 +15,7 @@
 #include "nklcd.h"
 #include "nktimer.h"
 #include "nksleep.h"
+#include "nkprof.h"
 
 #include "bggame.h"
 #include "bgmenu.h"
@@ -25,6 +25,8 @@ int main() {
     game_t game;
     // idle/sleep timer
     int8_t idle = 0;
+    // whether the menu started a game
+    uint8_t start;
 
     // the playing board
     game.width = MAX_WIDTH;
@@ -34,12 +36,19 @@ int main() {
     nklcd_init();
     nkbuttons_init();
     nktimer_init(60);
-    srand(nkrand_seed());
-    bghighscore_init();
+#ifdef NKPROF
+    nkprof_init();
+#endif
+    nkrand_start(&game.random, nkrand_seed());
     sei(); //enable interrupts
+    nklcd_queue_start();
+    bghighscore_init(&game);
 
     while(1) {
-        if (bgmenu_display(&game)) {
+        start = bgmenu_display(&game);
+        // scores are kept for each board the menu can choose
+        bghighscore_load(&game);
+        if (start) {
             idle = 0;
             bggame_play(&game);
             bggame_over(game.score);
@@ -11,17 +11,41 @@
 
 #include "nkbuttons.h"
 
+// the buttons held down, as of the last accepted edges
+volatile uint8_t nkbuttons_down = 0;
+// ticks of the animation timer, for stamping events
+volatile uint8_t nkbuttons_ticks = 0;
+// ticks left before each button accepts another edge
+uint8_t nkbuttons_lock[NKBUTTONS_COUNT];
+// ticks the held buttons have gone without changing
+uint8_t nkbuttons_held = 0;
+// whether the held buttons have already repeated
+// (smaller delay between firings after first repeat)
+uint8_t nkbuttons_is_repeat = 0;
+
+// events waiting to be read
+nkbuttons_event_t nkbuttons_queue[NKBUTTONS_QUEUE];
+// where the next event is added, and where the next is read from
+// (empty when they are equal)
+volatile uint8_t nkbuttons_head = 0, nkbuttons_tail = 0;
+
 ISR(PCINT1_vect) {
-    // only triggered when a button is used to wake up
+    // a button changed (this also wakes from sleep)
+    nkbuttons_sample();
 }
 
 // get the input pins setup at boot
 void nkbuttons_init() {
+    int8_t b;
     // Set the 6 pins to input mode - four directions + select
-    DDRC &= ~(B_LEFT|B_DOWN|B_UP|B_RIGHT|B_SELECT);
+    DDRC &= ~B_ALL;
 	  
     // turn on the internal resistors for the pins
-    PORTC |= (B_LEFT|B_DOWN|B_UP|B_RIGHT|B_SELECT);
+    PORTC |= B_ALL;
+
+    for (b = 0; b < NKBUTTONS_COUNT; b++)
+        nkbuttons_lock[b] = 0;
+    nkbuttons_enable_interrupts();
 }
 
 void nkbuttons_enable_interrupts() {
@@ -32,52 +56,86 @@ void nkbuttons_enable_interrupts() {
     PCICR |= (1<<PCIE1);
 }
 
-void nkbuttons_disable_interrupts() {
-    // enable bin change mask registers
-    PCMSK1 &= ~(B_LEFT_INT|B_DOWN_INT|B_UP_INT|B_RIGHT_INT|B_SELECT_INT);
+// accept any changed buttons that are not locked out, and queue an
+// event for the ones that went down (called with interrupts off)
+void nkbuttons_sample() {
+    uint8_t fresh = ~PINC & B_ALL;
+    uint8_t changed = fresh ^ nkbuttons_down;
+    uint8_t accepted = 0, bit;
+    int8_t b;
 
-    // enable Pin Change Interrupt 1
-    PCICR &= (1<<PCIE1);
+    for (b = 0, bit = 1; b < NKBUTTONS_COUNT; b++, bit <<= 1)
+        if ((changed & bit) && !nkbuttons_lock[b]) {
+            // take this edge right away, and ignore its bounces
+            nkbuttons_lock[b] = NKBUTTONS_LOCKOUT;
+            accepted |= bit;
+        }
+
+    if (accepted) {
+        nkbuttons_down ^= accepted;
+        nkbuttons_held = 0;
+        nkbuttons_is_repeat = 0;
+        if (accepted & fresh)
+            nkbuttons_push(accepted & fresh);
+    }
 }
 
-// check the state of the buttons, returns a mask of
-// what buttons are now pushed that weren't before
-uint8_t nkbuttons_read(nkbuttons_t *state) {
-    // get a fresh read
-    uint8_t fresh = ~PINC & (B_LEFT|B_DOWN|B_UP|B_RIGHT|B_SELECT);
+// add an event to the queue (dropped if the queue is full)
+void nkbuttons_push(uint8_t buttons) {
+    uint8_t next = (nkbuttons_head+1) % NKBUTTONS_QUEUE;
+    if (next == nkbuttons_tail)
+        return;
+    nkbuttons_queue[nkbuttons_head].buttons = buttons;
+    nkbuttons_queue[nkbuttons_head].tick = nkbuttons_ticks;
+    nkbuttons_head = next;
+}
 
-    // factor out bounces by sampling twice before determining
-    // what is actually pressed
-    uint8_t pressed = state->last_read & fresh;
-    state->last_read = fresh;
+// count one animation tick: end lockouts, and repeat held buttons
+// (called from the animation timer's interrupt)
+void nkbuttons_tick() {
+    int8_t b;
+    nkbuttons_ticks++;
+    for (b = 0; b < NKBUTTONS_COUNT; b++)
+        if (nkbuttons_lock[b])
+            nkbuttons_lock[b]--;
 
-    uint8_t newly = 0;
-    if (state->stable == pressed) {
-        if (++state->stable_count > (state->is_repeat ? 14 : 30)) {
-            state->stable_count = 0;
-            state->is_repeat = 1;
-            // trigger a key repeat, if it's still held down
-            newly = pressed;
-        }
-    } else {
-        state->stable_count = 0;
-        state->is_repeat = 0;
-        // find out what buttons are pushed now that weren't before
-        newly = (state->stable ^ pressed) & pressed;
-        state->stable = pressed;
+    // pick up any change that came in during a lockout
+    nkbuttons_sample();
+
+    if (nkbuttons_down &&
+        ++nkbuttons_held > (nkbuttons_is_repeat ?
+                            NKBUTTONS_REPEAT : NKBUTTONS_REPEAT_FIRST)) {
+        nkbuttons_held = 0;
+        nkbuttons_is_repeat = 1;
+        // trigger a key repeat, since it's still held down
+        nkbuttons_push(nkbuttons_down);
     }
+}
+
+// take the oldest event off of the queue, returns false if none waited
+uint8_t nkbuttons_next(nkbuttons_event_t *event) {
+    if (nkbuttons_head == nkbuttons_tail)
+        return 0;
+    *event = nkbuttons_queue[nkbuttons_tail];
+    nkbuttons_tail = (nkbuttons_tail+1) % NKBUTTONS_QUEUE;
+    return 1;
+}
 
-    // reply with newly-pushed buttons
+// drain the event queue, returns a mask of what buttons were pushed
+// (or repeated) since the last read
+uint8_t nkbuttons_read(nkbuttons_t *state) {
+    nkbuttons_event_t event;
+    uint8_t newly = 0;
+    while (nkbuttons_next(&event)) {
+        newly |= event.buttons;
+        state->tick = event.tick;
+    }
+    state->stable = nkbuttons_down;
     return newly;
 }
 
 // clear out all state for the button reader
 void nkbuttons_clear(nkbuttons_t *state) {
-    state->stable = 0;
-    state->last_read = 0;
-    state->stable_count = 0;
-    state->is_repeat = 0;
     // throw away buttons already pressed
     nkbuttons_read(state);
-    nkbuttons_read(state);
 }
@@ -9,10 +9,43 @@
 
 #include <inttypes.h>
 #include <avr/pgmspace.h>
+#include <avr/interrupt.h>
 
 #include "nkeeprom.h"
+#include "nkprof.h"
 
-char nkeeprom_read_byte(uint16_t address) {
+// writes waiting for the EEPROM, oldest first
+nkeeprom_job_t nkeeprom_jobs[NKEEPROM_JOBS];
+// number of jobs waiting
+volatile uint8_t nkeeprom_pending = 0;
+
+ISR(EE_READY_vect) {
+    nkeeprom_job_t *job = &nkeeprom_jobs[0];
+    uint8_t j;
+    while (nkeeprom_pending) {
+        if (job->count == 0) {
+            // this job is done, so move the rest up
+            for (j = 1; j < nkeeprom_pending; j++)
+                nkeeprom_jobs[j-1] = nkeeprom_jobs[j];
+            nkeeprom_pending--;
+            continue;
+        }
+        job->count--;
+        // skip bytes that are already right, and start one write
+        // per interrupt for the rest
+        if (nkeeprom_read_now(job->address) != *job->src)
+            nkeeprom_store(*job->src, job->address);
+        job->src++;
+        job->address++;
+        if (EECR & (1<<EEPE))
+            return;
+    }
+    // nothing left to write
+    EECR &= ~(1<<EERIE);
+}
+
+// read a byte, without waiting for queued writes
+char nkeeprom_read_now(uint16_t address) {
     // wait for completion of previous write)
     while (EECR & (1<<EEPE)) {}
     EEAR = address; //setup address
@@ -20,21 +53,406 @@ char nkeeprom_read_byte(uint16_t address) {
     return EEDR; // return data from register
 }
 
-void nkeeprom_write_byte(char byte, uint16_t address) {
+// start writing a byte, without waiting for queued writes
+void nkeeprom_store(char byte, uint16_t address) {
+    uint8_t sreg;
     // wait for completion of previous write
     while (EECR & (1<<EEPE)) {}
     EEAR = address; //setup address
     EEDR = byte; //setup data
+    // EEPE must be set within four cycles of EEMPE, so only this
+    // part has to keep interrupts out
+    sreg = SREG;
+    cli();
     EECR |= (1<<EEMPE); //enable writes
     EECR |= (1<<EEPE); //start write
+    SREG = sreg;
+}
+
+// return true while queued writes are still going
+uint8_t nkeeprom_busy() {
+    return (EECR & (1<<EEPE)) || nkeeprom_pending;
+}
+
+// wait for queued writes to finish (interrupts must be enabled)
+void nkeeprom_wait() {
+    NKPROF_START(NKPROF_EEPROM);
+    while (nkeeprom_busy()) {}
+    NKPROF_STOP(NKPROF_EEPROM);
+}
+
+// queue count bytes from src to be written starting at address, and
+// return right away; src must not change until nkeeprom_busy is false
+// (bytes that already match are skipped)
+void nkeeprom_write_async(unsigned char *src,
+                          uint16_t address,
+                          uint8_t count) {
+    NKPROF_START(NKPROF_EEPROM);
+    // wait for room
+    while (nkeeprom_pending >= NKEEPROM_JOBS) {}
+    // the interrupt only touches the job list while EERIE is set
+    EECR &= ~(1<<EERIE);
+    nkeeprom_jobs[nkeeprom_pending].src = src;
+    nkeeprom_jobs[nkeeprom_pending].address = address;
+    nkeeprom_jobs[nkeeprom_pending].count = count;
+    nkeeprom_pending++;
+    EECR |= (1<<EERIE);
+    NKPROF_STOP(NKPROF_EEPROM);
+}
+
+char nkeeprom_read_byte(uint16_t address) {
+    char byte;
+    NKPROF_START(NKPROF_EEPROM);
+    nkeeprom_wait();
+    byte = nkeeprom_read_now(address);
+    NKPROF_STOP(NKPROF_EEPROM);
+    return byte;
+}
+
+void nkeeprom_write_byte(char byte, uint16_t address) {
+    NKPROF_START(NKPROF_EEPROM);
+    nkeeprom_wait();
+    nkeeprom_store(byte, address);
+    NKPROF_STOP(NKPROF_EEPROM);
+}
+
+// write a byte only if it differs from what is already there
+// (saving the write's time, and the cell's wear)
+// returns true if the byte was written
+uint8_t nkeeprom_update_byte(char byte, uint16_t address) {
+    if (nkeeprom_read_byte(address) == byte)
+        return 0;
+    nkeeprom_write_byte(byte, address);
+    return 1;
 }
 
 void nkeeprom_read_bytes(unsigned char *dest, uint16_t offset, int16_t count) {
+    NKPROF_START(NKPROF_EEPROM);
     for (; count > 0; count--, dest++, offset++) 
         *dest = nkeeprom_read_byte(offset);
+    NKPROF_STOP(NKPROF_EEPROM);
+}
+
+// set up a ring of records (call nkeeprom_ring_read to find the newest)
+void nkeeprom_ring_init(nkeeprom_ring_t *ring,
+                        uint16_t base,
+                        uint8_t slots,
+                        uint8_t size) {
+    ring->base = base;
+    ring->slots = slots;
+    ring->size = size;
+    ring->newest = -1;
+    ring->sequence = 0;
+}
+
+uint16_t nkeeprom_ring_address(nkeeprom_ring_t *ring, int8_t slot) {
+    return ring->base + slot*(ring->size+2);
+}
+
+uint8_t nkeeprom_ring_check(unsigned char *payload,
+                            uint8_t size,
+                            uint8_t sequence) {
+    uint8_t x = NKEEPROM_CHECK ^ sequence;
+    for (; size > 0; size--, payload++)
+        x ^= *payload;
+    return x;
+}
+
+// return true if the record in a slot is whole
+uint8_t nkeeprom_ring_valid(nkeeprom_ring_t *ring, int8_t slot) {
+    uint16_t address = nkeeprom_ring_address(ring, slot);
+    uint8_t i, x = NKEEPROM_CHECK;
+    // the check byte covers the payload and the sequence number,
+    // so xoring all of them with it leaves zero
+    for (i = 0; i < ring->size+2; i++)
+        x ^= nkeeprom_read_byte(address+i);
+    return x == 0;
+}
+
+// find the newest valid record and read its payload into dest
+// returns false if the ring holds no valid record
+uint8_t nkeeprom_ring_read(nkeeprom_ring_t *ring, unsigned char *dest) {
+    int8_t s;
+    uint8_t sequence;
+    ring->newest = -1;
+    for (s = 0; s < ring->slots; s++) {
+        sequence = nkeeprom_read_byte(nkeeprom_ring_address(ring, s)
+                                      +ring->size+1);
+        // sequence numbers wrap, but live ones span fewer than 128,
+        // so a record is newer if it is less than 128 ahead
+        if (ring->newest >= 0 &&
+            (uint8_t)(sequence - ring->sequence) >= 128)
+            continue;
+        if (nkeeprom_ring_valid(ring, s)) {
+            ring->newest = s;
+            ring->sequence = sequence;
+        }
+    }
+    if (ring->newest < 0)
+        return 0;
+    nkeeprom_read_bytes(dest,
+                        nkeeprom_ring_address(ring, ring->newest),
+                        ring->size);
+    return 1;
+}
+
+// add count bytes of data to a CRC-8 (MSB first, no final xor)
+uint8_t nkeeprom_crc8(uint8_t crc, unsigned char *data, uint8_t count) {
+    uint8_t bit;
+    for (; count > 0; count--, data++) {
+        crc ^= *data;
+        for (bit = 0; bit < 8; bit++)
+            crc = (crc & 0x80) ? (crc << 1) ^ NKEEPROM_CRC8 : (crc << 1);
+    }
+    return crc;
+}
+
+// set up a table store, and find which of its records are whole
+// (check nkeeprom_tables_formatted before using it)
+void nkeeprom_tables_init(nkeeprom_tables_t *tables,
+                          uint16_t base,
+                          uint8_t version,
+                          uint8_t slots,
+                          uint8_t size) {
+    tables->base = base;
+    tables->version = version;
+    tables->slots = slots;
+    tables->size = size;
+    tables->valid = 0;
+    tables->sequence = 0;
+    if (nkeeprom_tables_formatted(tables))
+        nkeeprom_tables_scan(tables);
+}
+
+// return true if the header says the store is in this format
+uint8_t nkeeprom_tables_formatted(nkeeprom_tables_t *tables) {
+    return nkeeprom_read_byte(tables->base) == NKEEPROM_MAGIC0 &&
+        nkeeprom_read_byte(tables->base+1) == NKEEPROM_MAGIC1 &&
+        nkeeprom_read_byte(tables->base+2) == tables->version;
+}
+
+// empty the store (waits for the writes to finish)
+void nkeeprom_tables_format(nkeeprom_tables_t *tables) {
+    nkeeprom_tables_format_keeping(tables, -1);
+}
+
+// empty every slot of the store but keep (-1 for none), whose record
+// stays (waits for the writes to finish)
+void nkeeprom_tables_format_keeping(nkeeprom_tables_t *tables, int8_t keep) {
+    int8_t s;
+    uint16_t address;
+    // whatever was here before could pass a CRC by chance, so mark
+    // every entry empty before the header says the store is ready
+    for (s = 0; s < tables->slots; s++) {
+        if (s == keep)
+            continue;
+        address = nkeeprom_tables_entry(tables, s);
+        nkeeprom_update_byte(NKEEPROM_EMPTY >> 8, address);
+        nkeeprom_update_byte(NKEEPROM_EMPTY & 0xFF, address+1);
+    }
+    nkeeprom_update_byte(NKEEPROM_MAGIC0, tables->base);
+    nkeeprom_update_byte(NKEEPROM_MAGIC1, tables->base+1);
+    nkeeprom_update_byte(tables->version, tables->base+2);
+    nkeeprom_wait();
+    tables->valid = keep >= 0 ? (uint32_t)1 << keep : 0;
+    tables->sequence = keep >= 0 ? nkeeprom_tables_sequence(tables, keep) : 0;
+}
+
+// true if count bytes from address share any with from..to-1
+#define NKEEPROM_OVERLAP(address, count, from, to) \
+    ((address) < (to) && (from) < (address)+(count))
+
+// format the store with one record in it, carried over from an older
+// layout whose bytes from..to-1 the store covers; the record goes
+// into a slot clear of those bytes first, so a reset part way through
+// leaves either the old layout whole, or the record for
+// nkeeprom_tables_recover to find (waits for the writes to finish)
+void nkeeprom_tables_migrate(nkeeprom_tables_t *tables,
+                             uint16_t key,
+                             unsigned char *src,
+                             uint16_t from,
+                             uint16_t to) {
+    int8_t s;
+    for (s = 0; s < tables->slots; s++)
+        if (!NKEEPROM_OVERLAP(nkeeprom_tables_entry(tables, s),
+                              NKEEPROM_ENTRY, from, to) &&
+            !NKEEPROM_OVERLAP(nkeeprom_tables_record(tables, s),
+                              tables->size+1, from, to))
+            break;
+    if (s == tables->slots) {
+        // no slot is clear of the old layout: it can't be kept safe
+        nkeeprom_tables_format(tables);
+        nkeeprom_tables_write(tables, key, src);
+        nkeeprom_wait();
+        return;
+    }
+    // the first record of a store is sequence number 1
+    tables->valid = 0;
+    tables->sequence = 0;
+    nkeeprom_tables_put(tables, s, key, src);
+    nkeeprom_wait();
+    nkeeprom_tables_format_keeping(tables, s);
+}
+
+// finish a migration that a reset cut short: if the unformatted store
+// already holds a whole first record, format the store around it
+// returns false if there is none (the old layout is still whole)
+uint8_t nkeeprom_tables_recover(nkeeprom_tables_t *tables) {
+    int8_t s;
+    nkeeprom_tables_scan(tables);
+    for (s = 0; s < tables->slots; s++)
+        if ((tables->valid & ((uint32_t)1 << s)) &&
+            nkeeprom_tables_sequence(tables, s) == 1) {
+            nkeeprom_tables_format_keeping(tables, s);
+            return 1;
+        }
+    tables->valid = 0;
+    tables->sequence = 0;
+    return 0;
+}
+
+uint16_t nkeeprom_tables_entry(nkeeprom_tables_t *tables, int8_t slot) {
+    return tables->base + NKEEPROM_HEADER + slot*NKEEPROM_ENTRY;
+}
+
+uint16_t nkeeprom_tables_record(nkeeprom_tables_t *tables, int8_t slot) {
+    return nkeeprom_tables_entry(tables, tables->slots) +
+        slot*(tables->size+1);
+}
+
+uint16_t nkeeprom_tables_key(nkeeprom_tables_t *tables, int8_t slot) {
+    uint16_t address = nkeeprom_tables_entry(tables, slot);
+    return ((uint8_t)nkeeprom_read_byte(address) << 8) |
+        (uint8_t)nkeeprom_read_byte(address+1);
+}
+
+uint16_t nkeeprom_tables_sequence(nkeeprom_tables_t *tables, int8_t slot) {
+    uint16_t address = nkeeprom_tables_entry(tables, slot)+2;
+    return ((uint8_t)nkeeprom_read_byte(address) << 8) |
+        (uint8_t)nkeeprom_read_byte(address+1);
+}
+
+// check the CRC of every record, and find the newest sequence number
+void nkeeprom_tables_scan(nkeeprom_tables_t *tables) {
+    unsigned char entry[NKEEPROM_ENTRY], c;
+    uint8_t crc, i;
+    uint16_t address, sequence;
+    int8_t s;
+    tables->valid = 0;
+    tables->sequence = 0;
+    for (s = 0; s < tables->slots; s++) {
+        nkeeprom_read_bytes(entry,
+                            nkeeprom_tables_entry(tables, s),
+                            NKEEPROM_ENTRY);
+        if (entry[0] == (NKEEPROM_EMPTY >> 8) &&
+            entry[1] == (NKEEPROM_EMPTY & 0xFF))
+            continue;
+        crc = nkeeprom_crc8(0, entry, NKEEPROM_ENTRY);
+        address = nkeeprom_tables_record(tables, s);
+        for (i = 0; i < tables->size; i++) {
+            c = nkeeprom_read_byte(address+i);
+            crc = nkeeprom_crc8(crc, &c, 1);
+        }
+        if (crc != (uint8_t)nkeeprom_read_byte(address+tables->size))
+            continue;
+        // sequence numbers wrap, but a record is newer if it is less
+        // than 0x8000 ahead
+        sequence = (entry[2] << 8) | entry[3];
+        if (!tables->valid ||
+            (uint16_t)(sequence - tables->sequence) < 0x8000)
+            tables->sequence = sequence;
+        tables->valid |= (uint32_t)1 << s;
+    }
+}
+
+// return the slot of the newest whole record for a key (-1 if none)
+int8_t nkeeprom_tables_find(nkeeprom_tables_t *tables, uint16_t key) {
+    int8_t s, found = -1;
+    uint16_t sequence, newest = 0;
+    for (s = 0; s < tables->slots; s++) {
+        if (!(tables->valid & ((uint32_t)1 << s)) ||
+            nkeeprom_tables_key(tables, s) != key)
+            continue;
+        sequence = nkeeprom_tables_sequence(tables, s);
+        if (found < 0 || (uint16_t)(sequence - newest) < 0x8000) {
+            found = s;
+            newest = sequence;
+        }
+    }
+    return found;
+}
+
+// choose the slot for the next write: an empty or broken slot if
+// there is one, or else the oldest record that has a newer copy, or
+// else the oldest record of all
+int8_t nkeeprom_tables_victim(nkeeprom_tables_t *tables) {
+    int8_t s, victim = -1;
+    uint16_t age, oldest = 0;
+    uint8_t stale, stalest = 0;
+    for (s = 0; s < tables->slots; s++) {
+        if (!(tables->valid & ((uint32_t)1 << s)))
+            return s;
+        age = tables->sequence - nkeeprom_tables_sequence(tables, s);
+        // stale records sort ahead of every newest copy
+        stale = nkeeprom_tables_find(tables,
+                                     nkeeprom_tables_key(tables, s)) != s;
+        if (victim < 0 || stale > stalest ||
+            (stale == stalest && age > oldest)) {
+            victim = s;
+            oldest = age;
+            stalest = stale;
+        }
+    }
+    return victim;
+}
+
+// read the newest record for a key into dest
+// returns false if the store has no whole record for the key
+uint8_t nkeeprom_tables_read(nkeeprom_tables_t *tables,
+                             uint16_t key,
+                             unsigned char *dest) {
+    int8_t slot = nkeeprom_tables_find(tables, key);
+    if (slot < 0)
+        return 0;
+    nkeeprom_read_bytes(dest, nkeeprom_tables_record(tables, slot),
+                        tables->size);
+    return 1;
+}
+
+// store a new record for a key, leaving the last one in place until
+// the new one is whole
+// the write finishes in the background (see nkeeprom_write_async)
+void nkeeprom_tables_write(nkeeprom_tables_t *tables,
+                           uint16_t key,
+                           unsigned char *src) {
+    // the entry and CRC are written from the store, so the previous
+    // write has to be out of them first
+    nkeeprom_wait();
+    nkeeprom_tables_put(tables, nkeeprom_tables_victim(tables), key, src);
 }
 
-void nkeeprom_write_bytes(unsigned char *src, uint16_t offset, int16_t count) {
-    for(; count > 0; count--, src++, offset++)
-        nkeeprom_write_byte(*src, offset);
+// write the next record into a slot (once any earlier write is done)
+void nkeeprom_tables_put(nkeeprom_tables_t *tables,
+                         int8_t slot,
+                         uint16_t key,
+                         unsigned char *src) {
+    tables->sequence++;
+    tables->entry[0] = key >> 8;
+    tables->entry[1] = key & 0xFF;
+    tables->entry[2] = tables->sequence >> 8;
+    tables->entry[3] = tables->sequence & 0xFF;
+    tables->crc = nkeeprom_crc8(nkeeprom_crc8(0, tables->entry,
+                                              NKEEPROM_ENTRY),
+                                src, tables->size);
+    // the old entry stops matching the CRC as soon as the record
+    // starts changing, and the new entry goes in after the record
+    nkeeprom_write_async(src, nkeeprom_tables_record(tables, slot),
+                         tables->size);
+    nkeeprom_write_async(&tables->crc,
+                         nkeeprom_tables_record(tables, slot)+tables->size,
+                         1);
+    nkeeprom_write_async(tables->entry,
+                         nkeeprom_tables_entry(tables, slot),
+                         NKEEPROM_ENTRY);
+    tables->valid |= (uint32_t)1 << slot;
 }
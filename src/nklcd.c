@@ -6,32 +6,343 @@
 // utilities for manipulating the LCD
 
 #include <inttypes.h>
+#include <avr/pgmspace.h>
+#include <avr/interrupt.h>
+
 #include "lcd.h" //add nerdkits-provided library
 
 #include "nklcd.h"
+#include "nktimer.h"
+#include "nkprof.h"
+
+// what we last wrote to each position on the display
+char nklcd_shadow[NKLCD_ROWS][NKLCD_COLUMNS];
+// cells of the shadow that were never queued (one bit per column);
+// the interrupt sends them when the queue is empty
+volatile uint32_t nklcd_dirty[NKLCD_ROWS];
+
+// whether output goes through the queue, or straight to the display
+uint8_t nklcd_queued = 0;
+// bytes waiting to be sent (see NKLCD_Q_* for the high byte)
+uint16_t nklcd_queue[NKLCD_QUEUE];
+// where the next byte is added, and where the next is sent from
+// (empty when they are equal)
+volatile uint8_t nklcd_head = 0, nklcd_tail = 0;
+// queue ticks to wait before sending the next byte
+volatile uint8_t nklcd_hold = 0;
+// the display address the queued bytes sent so far leave it at
+uint8_t nklcd_at = 0;
+// whether sending dirty cells moved the display away from nklcd_at
+volatile uint8_t nklcd_moved = 0;
+// the dirty cell whose goto was just sent (row*NKLCD_COLUMNS+column),
+// or NKLCD_NONE
+#define NKLCD_NONE 0xFF
+volatile uint8_t nklcd_fixing = NKLCD_NONE;
+
+// find the next byte to send for the dirty cells
+// returns false if there are none, and the display is back where the
+// queue left it
+uint8_t nklcd_next_dirty(uint16_t *entry) {
+    int8_t r, c;
+    uint32_t bits;
+    if (nklcd_fixing != NKLCD_NONE) {
+        // the goto went out, so the piece follows
+        r = nklcd_fixing / NKLCD_COLUMNS;
+        c = nklcd_fixing % NKLCD_COLUMNS;
+        nklcd_fixing = NKLCD_NONE;
+        nklcd_dirty[r] &= ~((uint32_t)1 << c);
+        *entry = (uint8_t)nklcd_shadow[r][c];
+        return 1;
+    }
+    for (r = 0; r < NKLCD_ROWS; r++) {
+        if (!(bits = nklcd_dirty[r]))
+            continue;
+        for (c = 0; !(bits & 1); c++)
+            bits >>= 1;
+        nklcd_fixing = r*NKLCD_COLUMNS + c;
+        nklcd_moved = 1;
+        *entry = NKLCD_Q_COMMAND | ADDRESS_CMD | nklcd_address(r, c);
+        return 1;
+    }
+    if (!nklcd_moved)
+        return 0;
+    // leave the display where the queue's last goto put it, which is
+    // where the cursor blinks
+    *entry = NKLCD_Q_COMMAND | ADDRESS_CMD | nklcd_at;
+    nklcd_moved = 0;
+    return 1;
+}
+
+// the next byte to send from the queue (which must not be empty)
+uint16_t nklcd_next_queued() {
+    uint16_t entry = nklcd_queue[nklcd_tail];
+    // a dirty cell's goto is stale once anything else goes out
+    nklcd_fixing = NKLCD_NONE;
+    if (nklcd_moved && !(entry & NKLCD_Q_COMMAND)) {
+        // data follows on from the queued bytes before it, so the
+        // display goes back there first
+        nklcd_moved = 0;
+        return NKLCD_Q_COMMAND | ADDRESS_CMD | nklcd_at;
+    }
+    nklcd_tail = (nklcd_tail+1) % NKLCD_QUEUE;
+    if (!(entry & NKLCD_Q_COMMAND)) {
+        nklcd_at++;
+    } else if (entry & ADDRESS_CMD) {
+        nklcd_at = entry & ~(NKLCD_Q_COMMAND | ADDRESS_CMD);
+        nklcd_moved = 0;
+    } else if ((uint8_t)entry == CLEAR_CMD) {
+        nklcd_at = 0;
+        nklcd_moved = 0;
+    }
+    return entry;
+}
+
+ISR(TIMER2_COMPA_vect) {
+    uint16_t entry;
+    if (nklcd_hold) {
+        // the display is still busy with a slow command
+        nklcd_hold--;
+        return;
+    }
+    if (nklcd_head != nklcd_tail) {
+        entry = nklcd_next_queued();
+    } else if (!nklcd_next_dirty(&entry)) {
+        // nothing left to send; nklcd_send and nklcd_mark_cell turn
+        // this back on
+        TIMSK2 &= ~(1<<OCIE2A);
+        return;
+    }
+
+    if (entry & NKLCD_Q_COMMAND)
+        lcd_set_type_command();
+    else
+        lcd_set_type_data();
+    // the timer's period stands in for lcd_write_byte's delay
+    lcd_write_nibble(entry >> 4);
+    lcd_write_nibble(entry);
+    if (entry & NKLCD_Q_SLOW)
+        nklcd_hold = NKLCD_CLEAR_TICKS;
+}
 
 // get the LCD setup at boot
 void nklcd_init() {
     lcd_init();
-    lcd_home();
+    nklcd_clear();
 }
 
 void nklcd_start_blinking() {
-    lcd_set_type_command();
-    lcd_write_byte(DISPLAY_CMD|DISPLAY_ON|DISPLAY_CURSOR|DISPLAY_BLINK);
+    nklcd_command(DISPLAY_CMD|DISPLAY_ON|DISPLAY_CURSOR|DISPLAY_BLINK);
 }
 
 void nklcd_stop_blinking() {
-    lcd_set_type_command();
-    lcd_write_byte(DISPLAY_CMD|DISPLAY_ON);
+    nklcd_command(DISPLAY_CMD|DISPLAY_ON);
 }
 
 void nklcd_off() {
-    lcd_set_type_command();
-    lcd_write_byte(DISPLAY_CMD);
+    nklcd_command(DISPLAY_CMD);
 }
 
 void nklcd_on() {
-    lcd_set_type_command();
-    lcd_write_byte(DISPLAY_CMD|DISPLAY_ON);
+    nklcd_command(DISPLAY_CMD|DISPLAY_ON);
+}
+
+// send display output through the queue from now on, so that
+// writes return without waiting for the display
+void nklcd_queue_start() {
+    // Clear Timer on Compare Match of OCR2A
+    TCCR2A |= (1<<WGM21);
+    // choose clock source as system/prescaler32
+    TCCR2B |= (1<<CS21) | (1<<CS20);
+    OCR2A = (F_CPU / 32 / NKLCD_QUEUE_HZ) - 1;
+    nklcd_queued = 1;
+}
+
+// send display output straight to the display again
+void nklcd_queue_stop() {
+    nklcd_flush();
+    nklcd_queued = 0;
+}
+
+// return true if any cell is waiting for the interrupt to send it
+uint8_t nklcd_dirty_cells() {
+    int8_t r;
+    for (r = 0; r < NKLCD_ROWS; r++)
+        if (nklcd_dirty[r])
+            return 1;
+    return 0;
+}
+
+// wait for everything queued to reach the display
+// (interrupts must be enabled)
+void nklcd_flush() {
+    NKPROF_START(NKPROF_LCD);
+    while (nklcd_head != nklcd_tail || nklcd_hold || nklcd_moved ||
+           nklcd_dirty_cells()) {}
+    NKPROF_STOP(NKPROF_LCD);
+}
+
+// add a byte to the queue, waiting for room if it is full
+void nklcd_send(uint16_t entry) {
+    uint8_t next = (nklcd_head+1) % NKLCD_QUEUE;
+    while (next == nklcd_tail) {}
+    nklcd_queue[nklcd_head] = entry;
+    nklcd_head = next;
+    // the interrupt only turns itself off when the queue is empty,
+    // which it can no longer be, so this can't undo that
+    TIMSK2 |= (1<<OCIE2A);
+}
+
+// the number of bytes that can be queued without waiting
+uint8_t nklcd_room() {
+    return (nklcd_tail + NKLCD_QUEUE - nklcd_head - 1) % NKLCD_QUEUE;
+}
+
+void nklcd_command(uint8_t command) {
+    NKPROF_START(NKPROF_LCD);
+    if (nklcd_queued) {
+        nklcd_send(NKLCD_Q_COMMAND | command);
+    } else {
+        lcd_set_type_command();
+        lcd_write_byte(command);
+    }
+    NKPROF_STOP(NKPROF_LCD);
+}
+
+void nklcd_goto_position(uint8_t row, uint8_t column) {
+    NKPROF_START(NKPROF_LCD);
+    if (nklcd_queued)
+        nklcd_send(NKLCD_Q_COMMAND | ADDRESS_CMD | nklcd_address(row, column));
+    else
+        lcd_goto_position(row, column);
+    NKPROF_STOP(NKPROF_LCD);
+}
+
+void nklcd_write_data(char c) {
+    NKPROF_START(NKPROF_LCD);
+    if (nklcd_queued)
+        nklcd_send((uint8_t)c);
+    else
+        lcd_write_data(c);
+    NKPROF_STOP(NKPROF_LCD);
+}
+
+// write a string from program memory
+void nklcd_write_string(const char *s) {
+    char c;
+    NKPROF_START(NKPROF_LCD);
+    while ((c = pgm_read_byte(s++)))
+        nklcd_write_data(c);
+    NKPROF_STOP(NKPROF_LCD);
+}
+
+// write a number, as lcd_write_int16 does
+void nklcd_write_int16(int16_t in) {
+    uint8_t started = 0;
+    uint16_t pow = 10000;
+    NKPROF_START(NKPROF_LCD);
+    if (in < 0) {
+        nklcd_write_data('-');
+        in = -in;
+    }
+    for (; pow >= 1; pow /= 10) {
+        if (in / pow > 0 || started || pow == 1) {
+            nklcd_write_data('0' + in / pow);
+            started = 1;
+            in = in % pow;
+        }
+    }
+    NKPROF_STOP(NKPROF_LCD);
+}
+
+// display memory address of a position on the display
+// (rows 0 and 2 are one run of memory, as are rows 1 and 3)
+uint8_t nklcd_address(int8_t row, int8_t column) {
+    return ((row & 1) ? 0x40 : 0) + ((row & 2) ? NKLCD_COLUMNS : 0) + column;
+}
+
+// blank the display, and the shadow of it
+void nklcd_clear() {
+    int8_t r, c;
+    NKPROF_START(NKPROF_LCD);
+    if (nklcd_queued)
+        nklcd_send(NKLCD_Q_COMMAND | NKLCD_Q_SLOW | CLEAR_CMD);
+    else
+        lcd_clear_and_home();
+    for (r = 0; r < NKLCD_ROWS; r++) {
+        // a blank display leaves no dirty cells to catch up on
+        nklcd_dirty[r] = 0;
+        for (c = 0; c < NKLCD_COLUMNS; c++)
+            nklcd_shadow[r][c] = ' ';
+    }
+    NKPROF_STOP(NKPROF_LCD);
+}
+
+// note a character in the shadow only, for the queue's interrupt to
+// send once the queue is empty (the queue must be started)
+void nklcd_mark_cell(int8_t row, int8_t column, char c) {
+    nklcd_shadow[row][column] = c;
+    // the interrupt only clears bits, so if it clears another one
+    // part way through this, the worst is that cell being sent twice
+    nklcd_dirty[row] |= (uint32_t)1 << column;
+    TIMSK2 |= (1<<OCIE2A);
+}
+
+// write one character, and note it in the shadow
+// (when the queue is too full to take it, only the shadow changes)
+void nklcd_write_cell(int8_t row, int8_t column, char c) {
+    NKPROF_START(NKPROF_LCD);
+    if (nklcd_queued && nklcd_room() < 2+NKLCD_QUEUE_SPARE) {
+        nklcd_mark_cell(row, column, c);
+    } else {
+        nklcd_shadow[row][column] = c;
+        nklcd_goto_position(row, column);
+        nklcd_write_data(c);
+    }
+    NKPROF_STOP(NKPROF_LCD);
+}
+
+// bring the display up to date with a grid of characters,
+// writing only the ones that differ from the shadow (and leaving the
+// rest to the queue's interrupt, once the queue fills)
+// (stride is the distance between the starts of rows in cells;
+// cells past the edge of the display are left off)
+void nklcd_write_grid(const char *cells,
+                      int8_t stride,
+                      int8_t rows,
+                      int8_t columns) {
+    int8_t i, r, c;
+    const char *row;
+    // the address the display will write to next (0xFF is unknown)
+    uint8_t next = 0xFF, address;
+    NKPROF_START(NKPROF_LCD);
+    if (columns > NKLCD_COLUMNS)
+        columns = NKLCD_COLUMNS;
+    for (i = 0; i < NKLCD_ROWS; i++) {
+        // visit rows in display memory order (0, 2, 1, 3), so that
+        // a run off the end of one row can continue on the next
+        r = ((i & 1) << 1) | (i >> 1);
+        if (r >= rows)
+            continue;
+        row = cells + r*stride;
+        for (c = 0; c < columns; c++) {
+            if (nklcd_shadow[r][c] != row[c]) {
+                if (nklcd_queued &&
+                    nklcd_room() < 2+NKLCD_QUEUE_SPARE) {
+                    // no room to queue it without waiting; the display
+                    // address queued so far is still next
+                    nklcd_mark_cell(r, c, row[c]);
+                    continue;
+                }
+                address = nklcd_address(r, c);
+                // the display moves to the next address after each
+                // write, so only runs that don't follow on need a goto
+                if (address != next)
+                    nklcd_goto_position(r, c);
+                nklcd_shadow[r][c] = row[c];
+                nklcd_write_data(row[c]);
+                next = address+1;
+            }
+        }
+    }
+    NKPROF_STOP(NKPROF_LCD);
 }
@@ -0,0 +1,171 @@
+// blockgame
+// for NerdKits with ATmega168
+// copyright 2011 Bryan Fink
+// license: see LICENSE.txt
+
+// counting the cycles spent in the busiest parts of the game
+
+#include <inttypes.h>
+#include <avr/pgmspace.h>
+#include <avr/interrupt.h>
+
+#include "nkprof.h"
+#include "nklcd.h"
+#include "nkbuttons.h"
+#include "nktimer.h"
+
+#ifdef NKPROF
+
+nkprof_total_t nkprof_totals[NKPROF_REGIONS];
+// when the outermost call into each region started
+uint32_t nkprof_started[NKPROF_REGIONS];
+// calls into each region that haven't returned yet (a region that
+// calls itself, or another function in the same region, is timed
+// once, from the outermost call)
+uint8_t nkprof_depth[NKPROF_REGIONS];
+// high half of the cycle count
+volatile uint16_t nkprof_overflows = 0;
+
+// lines on the stats screen: the regions, then the timer's screens
+#define NKPROF_LINES (NKPROF_REGIONS+NKTIMER_SCREENS)
+
+// names on the stats screen, in line order
+const char nkprof_names[NKPROF_LINES][3] PROGMEM = {
+    "MS", "VM", "FI", "LC", "EE", "MN", "GM", "HS", "GO"
+};
+
+ISR(TIMER1_OVF_vect) {
+    nkprof_overflows++;
+}
+
+// start Timer1 counting every cycle (call before interrupts are on)
+void nkprof_init() {
+    // normal mode, counting up from 0 to 0xFFFF and around again
+    TCCR1A = 0;
+    // choose clock source as system/prescaler1
+    TCCR1B = (1<<CS10);
+    // enable Timer1 Overflow Interrupt
+    TIMSK1 |= (1<<TOIE1);
+    nkprof_reset();
+}
+
+// zero every region's totals, and the timer's frame counts
+void nkprof_reset() {
+    int8_t r;
+    for (r = 0; r < NKPROF_REGIONS; r++) {
+        nkprof_totals[r].calls = 0;
+        nkprof_totals[r].cycles = 0;
+        nkprof_depth[r] = 0;
+    }
+    for (r = 0; r < NKTIMER_SCREENS; r++)
+        nktimer_frames[r].frames = nktimer_frames[r].overruns = 0;
+}
+
+// cycles since nkprof_init (wrapping around at 2^32)
+uint32_t nkprof_now() {
+    uint16_t low, high;
+    uint8_t sreg = SREG;
+    cli();
+    low = TCNT1;
+    high = nkprof_overflows;
+    // an overflow that came while interrupts were off hasn't been
+    // counted yet; if TCNT1 is low, it happened before the read
+    if ((TIFR1 & (1<<TOV1)) && low < 0x8000)
+        high++;
+    SREG = sreg;
+    return ((uint32_t)high << 16) | low;
+}
+
+void nkprof_start(uint8_t region) {
+    if (nkprof_depth[region]++ == 0)
+        nkprof_started[region] = nkprof_now();
+}
+
+void nkprof_stop(uint8_t region) {
+    nkprof_total_t *total = &nkprof_totals[region];
+    if (--nkprof_depth[region] != 0)
+        return;
+    total->cycles += nkprof_now() - nkprof_started[region];
+    if (total->calls < 0xFFFF)
+        total->calls++;
+}
+
+// write an unsigned number (nklcd_write_int16 stops at 32767)
+void nkprof_write_number(uint32_t n) {
+    char digits[10];
+    int8_t d = 0;
+    do {
+        digits[d++] = '0' + n % 10;
+        n /= 10;
+    } while (n);
+    while (d > 0)
+        nklcd_write_data(digits[--d]);
+}
+
+// the stats screen's state between ticks
+typedef struct {
+    // the totals when the screen opened
+    nkprof_total_t shown[NKPROF_LINES];
+    nkbuttons_t button_state;
+    // the line at the top of the display
+    int8_t first;
+} nkprof_view_t;
+
+void nkprof_draw(const nkprof_view_t *view) {
+    int8_t r;
+    nklcd_clear();
+    for (r = 0; r < NKLCD_ROWS && view->first+r < NKPROF_LINES; r++) {
+        nklcd_goto_position(r, 0);
+        nklcd_write_string(nkprof_names[view->first+r]);
+        nklcd_write_data(' ');
+        nkprof_write_number(view->shown[view->first+r].calls);
+        nklcd_write_data(' ');
+        nkprof_write_number(view->shown[view->first+r].cycles);
+    }
+}
+
+// handle one tick's presses: Up and Down scroll, Select zeroes the
+// totals, and Left or Right leaves
+int16_t nkprof_task(void *state) {
+    nkprof_view_t *view = (nkprof_view_t*)state;
+    uint8_t pressed = nkbuttons_read(&view->button_state);
+    // the chord that opened the screen may still be repeating
+    if ((pressed & NKPROF_CHORD) == NKPROF_CHORD)
+        pressed = 0;
+    if (!pressed)
+        return 1;
+
+    if (pressed & B_SELECT) {
+        nkprof_reset();
+        return 0;
+    }
+    if (pressed & (B_LEFT|B_RIGHT))
+        return 0;
+    if ((pressed & B_DOWN) && view->first+NKLCD_ROWS < NKPROF_LINES)
+        view->first++;
+    else if ((pressed & B_UP) && view->first > 0)
+        view->first--;
+    nkprof_draw(view);
+    return 1;
+}
+
+// show each region's calls and cycles, and then each screen's frames
+// and the ticks they overran by, one per line
+void nkprof_screen() {
+    nkprof_view_t view;
+    int8_t r;
+
+    // copy the totals, so that drawing them doesn't change them
+    for (r = 0; r < NKPROF_REGIONS; r++)
+        view.shown[r] = nkprof_totals[r];
+    for (r = 0; r < NKTIMER_SCREENS; r++) {
+        view.shown[NKPROF_REGIONS+r].calls = nktimer_frames[r].frames;
+        view.shown[NKPROF_REGIONS+r].cycles = nktimer_frames[r].overruns;
+    }
+    nkbuttons_clear(&view.button_state);
+    view.first = 0;
+    nkprof_draw(&view);
+    nktimer_run(nkprof_task, &view, 1);
+}
+
+#endif
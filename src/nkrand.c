@@ -73,3 +73,27 @@ uint16_t nkrand_seed() {
 
     return seed;
 }
+
+// begin a pseudo-random sequence
+void nkrand_start(nkrand_t *state, uint16_t seed) {
+    // xorshift never leaves zero, so avoid starting there
+    *state = seed ? seed : 1;
+}
+
+// advance a pseudo-random sequence (16-bit xorshift, with the
+// 7/9/8 shift triple: every non-zero state is visited once per
+// 65535 steps, and each shift is cheap on an 8-bit MCU)
+uint16_t nkrand_next(nkrand_t *state) {
+    uint16_t x = *state;
+    x ^= x << 7;
+    x ^= x >> 9;
+    x ^= x << 8;
+    return *state = x;
+}
+
+// return a pseudo-random number from 0 to n-1
+// (scaling the high byte by n needs one 8x8 multiply, where
+// taking a remainder would need a software division)
+uint8_t nkrand_below(nkrand_t *state, uint8_t n) {
+    return ((nkrand_next(state) >> 8) * n) >> 8;
+}
@@ -13,20 +13,23 @@
 #include "nksleep.h"
 #include "nklcd.h"
 #include "nkbuttons.h"
+#include "nkeeprom.h"
 #include "nktimer.h"
 
 void nksleep_standby() {
     nklcd_off();
-    nkbuttons_enable_interrupts();
+    // the display queue stops with the clock, so empty it first
+    nklcd_flush();
+    // EEPROM writes can't finish during standby either
+    nkeeprom_wait();
     nktimer_pause();
-    // SLEEP
+    // SLEEP (a button's pin change interrupt wakes us)
     SMCR = (1<<SM2)|(1<<SM1); //standby
     sleep_enable();
     sleep_cpu();
     sleep_disable();
     // ENDSLEEP
     nktimer_resume();
-    nkbuttons_disable_interrupts();
     nklcd_on();
     sei();
 }
@@ -8,16 +8,26 @@
 #include <inttypes.h>
 #include <avr/pgmspace.h>
 #include <avr/interrupt.h>
+#include <avr/sleep.h>
 
 #include "nktimer.h"
 #include "nkbuttons.h"
 
-// wheter or not the animate timer has clicked
-volatile int animatev = 0;
+// animation timer clicks since boot (read it with nktimer_now; it
+// wraps every 18 minutes at 60Hz, so compare ticks by subtracting)
+volatile uint16_t nktimer_ticks = 0;
+// the tick the running screen has caught up to
+uint16_t nktimer_seen = 0;
+// the screen whose frames are being counted
+uint8_t nktimer_screen_id = 0;
+nktimer_frames_t nktimer_frames[NKTIMER_SCREENS];
+// the tasks waiting on the timer
+nktimer_slot_t nktimer_tasks[NKTIMER_TASKS];
 
 ISR(TIMER0_COMPA_vect) {
     // time to cycle animations
-    animatev = 1;
+    nktimer_ticks++;
+    nkbuttons_tick();
 }
 
 // configure the animation timer at boot
@@ -39,6 +49,8 @@ void nktimer_init(int8_t freq) {
 }
 
 void nktimer_resume() {
+    // the time spent paused isn't an overrun
+    nktimer_seen = nktimer_now();
     // endable Timer Output Compare Match A Interrupt 0
     TIMSK0 |= (1<<OCIE0A);
 }
@@ -48,23 +60,135 @@ void nktimer_pause() {
     TIMSK0 &= ~(1<<OCIE0A);
 }    
 
-uint8_t nktimer_animate() {
-    if (animatev) {
-        animatev = 0;
-        return 1;
+// the tick count, read with interrupts off (on AVR a 16-bit read
+// takes two instructions, and the timer could click between them)
+uint16_t nktimer_now() {
+    uint16_t now;
+    uint8_t sreg = SREG;
+    cli();
+    now = nktimer_ticks;
+    SREG = sreg;
+    return now;
+}
+
+// start counting frames for a screen, from now (the time spent
+// setting it up isn't an overrun)
+void nktimer_screen(uint8_t screen) {
+    nktimer_screen_id = screen;
+    nktimer_seen = nktimer_now();
+}
+
+// returns the ticks since the screen last caught up (0 if the timer
+// hasn't clicked since), and catches up; a frame that took more than
+// one tick counts the extra ones as overrun
+uint16_t nktimer_animate() {
+    nktimer_frames_t *count = &nktimer_frames[nktimer_screen_id];
+    uint16_t now = nktimer_now();
+    uint16_t elapsed = now - nktimer_seen;
+    uint32_t overruns;
+    if (elapsed == 0)
+        return 0;
+    nktimer_seen = now;
+    if (count->frames < 0xFFFF)
+        count->frames++;
+    overruns = (uint32_t)count->overruns + elapsed-1;
+    count->overruns = overruns > 0xFFFF ? 0xFFFF : overruns;
+    return elapsed;
+}
+
+// sleep until the animation timer clicks, and return the ticks since
+// the last wait (more than 1 if the frame between overran)
+uint16_t nktimer_wait() {
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    cli();
+    // other interrupts (buttons, the display queue) also wake the
+    // CPU, so check again each time it does
+    while (nktimer_ticks == nktimer_seen) {
+        sleep_enable();
+        // the instruction after sei always runs before any interrupt,
+        // so a click can't sneak in between the check and the sleep
+        sei();
+        sleep_cpu();
+        sleep_disable();
+        cli();
     }
-    return 0;
+    sei();
+    return nktimer_animate();
 }
 
-void nktimer_simple_delay(int16_t clicks) {
-    nkbuttons_t button_state;
-    nkbuttons_clear(&button_state);
+// put a task in the table, to run once ticks have passed (0 or 1 is
+// the next tick); returns its slot, or -1 if the table is full
+int8_t nktimer_add(nktimer_task_t task, void *state, int16_t ticks) {
+    int8_t s;
+    for (s = 0; s < NKTIMER_TASKS; s++)
+        if (!nktimer_tasks[s].task) {
+            nktimer_tasks[s].task = task;
+            nktimer_tasks[s].state = state;
+            nktimer_tasks[s].ticks = ticks > 0 ? ticks : 1;
+            nktimer_tasks[s].running = 0;
+            return s;
+        }
+    return -1;
+}
+
+// take a task out of the table before it has finished
+void nktimer_remove(int8_t slot) {
+    if (slot >= 0)
+        nktimer_tasks[slot].task = 0;
+}
 
-    while (clicks > 0) {
-        if (nktimer_animate()) {
-            clicks--;
-            if (nkbuttons_read(&button_state) & B_SELECT)
-                break; // skip duration if Select is pushed
+// sleep until the timer clicks, and run every task that has come due
+// since; a task that is still behind (because a frame overran) runs
+// again straight away, so it catches up instead of pushing back the
+// rest. A task running a nested nktimer_run waits for it to finish,
+// while the others keep their time.
+void nktimer_dispatch() {
+    uint16_t elapsed = nktimer_wait();
+    nktimer_slot_t *slot;
+    int16_t next;
+    // count the ticks off first, so that a task added by another
+    // during this dispatch waits from now
+    for (slot = nktimer_tasks; slot < nktimer_tasks+NKTIMER_TASKS; slot++)
+        if (slot->task && !slot->running)
+            slot->ticks -= elapsed;
+    for (slot = nktimer_tasks; slot < nktimer_tasks+NKTIMER_TASKS; slot++)
+        while (slot->task && !slot->running && slot->ticks <= 0) {
+            slot->running = 1;
+            next = slot->task(slot->state);
+            slot->running = 0;
+            if (next > 0)
+                slot->ticks += next;
+            else
+                slot->task = 0;
         }
-    }
+}
+
+// run a task until it is finished, along with the others in the table
+// (ticks is the wait before its first run)
+void nktimer_run(nktimer_task_t task, void *state, int16_t ticks) {
+    int8_t s = nktimer_add(task, state, ticks);
+    if (s < 0)
+        return;
+    while (nktimer_tasks[s].task == task && nktimer_tasks[s].state == state)
+        nktimer_dispatch();
+}
+
+typedef struct {
+    int16_t clicks;
+    nkbuttons_t button_state;
+} nktimer_delay_t;
+
+int16_t nktimer_delay_task(void *state) {
+    nktimer_delay_t *delay = (nktimer_delay_t*)state;
+    if (nkbuttons_read(&delay->button_state) & B_SELECT)
+        return 0; // skip duration if Select is pushed
+    return --delay->clicks > 0;
+}
+
+void nktimer_simple_delay(int16_t clicks) {
+    nktimer_delay_t delay;
+    delay.clicks = clicks;
+    nkbuttons_clear(&delay.button_state);
+    if (clicks > 0)
+        nktimer_run(nktimer_delay_task, &delay, 1);
 }
@@ -0,0 +1,346 @@
+/* bgbatch: advance many boards at once, for fuzzing and balancing */
+
+#include <string.h>
+
+#include <inttypes.h>
+
+#include "nkrand.h"
+
+#include "bggame.h"
+#include "bgbatch.h"
+
+// KERNELS
+//
+// Each kernel works on one cell (or one random state) of every board
+// in the batch.  The AVX2 and SSE2 versions must give exactly what the
+// scalar ones do; build with -DBGBATCH_SCALAR to check.
+
+#if defined(__AVX2__) && !defined(BGBATCH_SCALAR)
+
+#include <immintrin.h>
+
+#define BGBATCH_KERNELS "avx2"
+
+typedef __m256i lanes_t;
+#define LOAD(p) _mm256_loadu_si256((const __m256i*)(p))
+#define STORE(p, v) _mm256_storeu_si256((__m256i*)(p), v)
+
+// 0xFF in each lane where a is a piece, and b and c match it
+static void match3(const uint8_t *a, const uint8_t *b, const uint8_t *c,
+                   uint8_t *out) {
+    lanes_t va = LOAD(a);
+    lanes_t same = _mm256_and_si256(_mm256_cmpeq_epi8(va, LOAD(b)),
+                                    _mm256_cmpeq_epi8(va, LOAD(c)));
+    lanes_t space = _mm256_cmpeq_epi8(va, _mm256_setzero_si256());
+    STORE(out, _mm256_andnot_si256(space, same));
+}
+
+// one bit per lane, set where m is
+static uint32_t lanes(const uint8_t *m) {
+    return (uint32_t)_mm256_movemask_epi8(LOAD(m));
+}
+
+// add the lanes set in m to three cells' marks
+static void mark3(uint8_t *a, uint8_t *b, uint8_t *c, const uint8_t *m) {
+    lanes_t vm = LOAD(m);
+    STORE(a, _mm256_or_si256(LOAD(a), vm));
+    STORE(b, _mm256_or_si256(LOAD(b), vm));
+    STORE(c, _mm256_or_si256(LOAD(c), vm));
+}
+
+// turn marked pieces into spaces, counting them in removed
+static void clear_marked(uint8_t *type, const uint8_t *mark,
+                         uint8_t *removed) {
+    lanes_t vm = LOAD(mark);
+    STORE(type, _mm256_andnot_si256(vm, LOAD(type)));
+    // a mark is 0xFF, minus one
+    STORE(removed, _mm256_sub_epi8(LOAD(removed), vm));
+}
+
+// nkrand_next in every active lane, and the piece type that
+// bggame_random_piece would make of it
+static void draw(nkrand_t *random, const uint8_t *active, uint8_t n,
+                 uint8_t *types) {
+    lanes_t x, next, on, pieces[2];
+    int h;
+    for (h = 0; h < 2; h++) {
+        x = LOAD(random+16*h);
+        next = _mm256_xor_si256(x, _mm256_slli_epi16(x, 7));
+        next = _mm256_xor_si256(next, _mm256_srli_epi16(next, 9));
+        next = _mm256_xor_si256(next, _mm256_slli_epi16(next, 8));
+        on = _mm256_cvtepi8_epi16(
+            _mm_loadu_si128((const __m128i*)(active+16*h)));
+        x = _mm256_blendv_epi8(x, next, on);
+        STORE(random+16*h, x);
+        pieces[h] = _mm256_add_epi16(
+            _mm256_srli_epi16(
+                _mm256_mullo_epi16(_mm256_srli_epi16(x, 8),
+                                   _mm256_set1_epi16(n)), 8),
+            _mm256_set1_epi16(1));
+    }
+    // packing works within each 128-bit half, so put the quarters
+    // back in order afterward
+    STORE(types, _mm256_permute4x64_epi64(
+              _mm256_packus_epi16(pieces[0], pieces[1]), 0xD8));
+}
+
+#elif defined(__SSE2__) && !defined(BGBATCH_SCALAR)
+
+#include <emmintrin.h>
+
+#define BGBATCH_KERNELS "sse2"
+
+typedef __m128i lanes_t;
+#define LOAD(p) _mm_loadu_si128((const __m128i*)(p))
+#define STORE(p, v) _mm_storeu_si128((__m128i*)(p), v)
+
+static void match3(const uint8_t *a, const uint8_t *b, const uint8_t *c,
+                   uint8_t *out) {
+    lanes_t va, same, space;
+    int h;
+    for (h = 0; h < BGBATCH_LANES; h += 16) {
+        va = LOAD(a+h);
+        same = _mm_and_si128(_mm_cmpeq_epi8(va, LOAD(b+h)),
+                             _mm_cmpeq_epi8(va, LOAD(c+h)));
+        space = _mm_cmpeq_epi8(va, _mm_setzero_si128());
+        STORE(out+h, _mm_andnot_si128(space, same));
+    }
+}
+
+static uint32_t lanes(const uint8_t *m) {
+    return (uint32_t)_mm_movemask_epi8(LOAD(m)) |
+        ((uint32_t)_mm_movemask_epi8(LOAD(m+16)) << 16);
+}
+
+static void mark3(uint8_t *a, uint8_t *b, uint8_t *c, const uint8_t *m) {
+    lanes_t vm;
+    int h;
+    for (h = 0; h < BGBATCH_LANES; h += 16) {
+        vm = LOAD(m+h);
+        STORE(a+h, _mm_or_si128(LOAD(a+h), vm));
+        STORE(b+h, _mm_or_si128(LOAD(b+h), vm));
+        STORE(c+h, _mm_or_si128(LOAD(c+h), vm));
+    }
+}
+
+static void clear_marked(uint8_t *type, const uint8_t *mark,
+                         uint8_t *removed) {
+    lanes_t vm;
+    int h;
+    for (h = 0; h < BGBATCH_LANES; h += 16) {
+        vm = LOAD(mark+h);
+        STORE(type+h, _mm_andnot_si128(vm, LOAD(type+h)));
+        STORE(removed+h, _mm_sub_epi8(LOAD(removed+h), vm));
+    }
+}
+
+static void draw(nkrand_t *random, const uint8_t *active, uint8_t n,
+                 uint8_t *types) {
+    lanes_t x, next, on, bytes, pieces[2];
+    int h, q;
+    for (h = 0; h < 2; h++) {
+        bytes = LOAD(active+16*h);
+        for (q = 0; q < 2; q++) {
+            x = LOAD(random+16*h+8*q);
+            next = _mm_xor_si128(x, _mm_slli_epi16(x, 7));
+            next = _mm_xor_si128(next, _mm_srli_epi16(next, 9));
+            next = _mm_xor_si128(next, _mm_slli_epi16(next, 8));
+            // widen each lane's 0x00 or 0xFF to 16 bits
+            on = q ? _mm_unpackhi_epi8(bytes, bytes) :
+                _mm_unpacklo_epi8(bytes, bytes);
+            x = _mm_or_si128(_mm_and_si128(on, next),
+                             _mm_andnot_si128(on, x));
+            STORE(random+16*h+8*q, x);
+            pieces[q] = _mm_add_epi16(
+                _mm_srli_epi16(
+                    _mm_mullo_epi16(_mm_srli_epi16(x, 8),
+                                    _mm_set1_epi16(n)), 8),
+                _mm_set1_epi16(1));
+        }
+        STORE(types+16*h, _mm_packus_epi16(pieces[0], pieces[1]));
+    }
+}
+
+#else
+
+#define BGBATCH_KERNELS "scalar"
+
+static void match3(const uint8_t *a, const uint8_t *b, const uint8_t *c,
+                   uint8_t *out) {
+    int l;
+    for (l = 0; l < BGBATCH_LANES; l++)
+        out[l] = (a[l] && a[l] == b[l] && a[l] == c[l]) ? 0xFF : 0;
+}
+
+static uint32_t lanes(const uint8_t *m) {
+    uint32_t bits = 0;
+    int l;
+    for (l = 0; l < BGBATCH_LANES; l++)
+        bits |= (uint32_t)(m[l] & 1) << l;
+    return bits;
+}
+
+static void mark3(uint8_t *a, uint8_t *b, uint8_t *c, const uint8_t *m) {
+    int l;
+    for (l = 0; l < BGBATCH_LANES; l++) {
+        a[l] |= m[l];
+        b[l] |= m[l];
+        c[l] |= m[l];
+    }
+}
+
+static void clear_marked(uint8_t *type, const uint8_t *mark,
+                         uint8_t *removed) {
+    int l;
+    for (l = 0; l < BGBATCH_LANES; l++) {
+        type[l] &= ~mark[l];
+        removed[l] += mark[l] & 1;
+    }
+}
+
+static void draw(nkrand_t *random, const uint8_t *active, uint8_t n,
+                 uint8_t *types) {
+    int l;
+    for (l = 0; l < BGBATCH_LANES; l++)
+        if (active[l])
+            types[l] = 1+nkrand_below(&random[l], n);
+}
+
+#endif
+
+// BATCH
+
+// which kernels this build uses
+const char *bgbatch_kernels() {
+    return BGBATCH_KERNELS;
+}
+
+// copy one board into each lane (all the same size and variety)
+void bgbatch_load(bgbatch_t *batch, const game_t *games) {
+    int8_t r, c;
+    int l;
+    batch->width = games[0].width;
+    batch->height = games[0].height;
+    batch->variety = games[0].variety;
+    for (l = 0; l < BGBATCH_LANES; l++) {
+        for (r = 0; r < batch->height; r++)
+            for (c = 0; c < batch->width; c++) {
+                batch->type[r][c][l] = bggame_type(&games[l], r, c);
+                batch->mark[r][c][l] =
+                    (games[l].marks[r] >> c) & 1 ? 0xFF : 0;
+            }
+        batch->random[l] = games[l].random;
+    }
+}
+
+// copy each lane back out to a game
+void bgbatch_store(const bgbatch_t *batch, game_t *games) {
+    int8_t r, c;
+    int l;
+    for (l = 0; l < BGBATCH_LANES; l++) {
+        games[l].width = batch->width;
+        games[l].height = batch->height;
+        games[l].variety = batch->variety;
+        bggame_clear_marks(&games[l]);
+        for (r = 0; r < batch->height; r++)
+            for (c = 0; c < batch->width; c++) {
+                bggame_put(&games[l], r, c,
+                           BGGAME_PIECE(batch->type[r][c][l]));
+                if (batch->mark[r][c][l])
+                    games[l].marks[r] |= (bgbits_row_t)1 << c;
+            }
+        games[l].random = batch->random[l];
+    }
+}
+
+// bggame_clear_marks on every board (only the rows in use)
+static void clear_marks(bgbatch_t *batch) {
+    int8_t r;
+    for (r = 0; r < batch->height; r++)
+        memset(batch->mark[r], 0, batch->width*BGBATCH_LANES);
+}
+
+// bggame_mark_sets on every board; returns one bit per lane, set if
+// that board has a set
+uint32_t bgbatch_mark_sets(bgbatch_t *batch) {
+    uint8_t set[BGBATCH_LANES];
+    int8_t r, c, nr, nnr, nc, nnc;
+    uint32_t found = 0, lane;
+    clear_marks(batch);
+    for (r = 0; r < batch->height; r++) {
+        nr = r+1 < batch->height ? r+1 : 0;
+        nnr = nr+1 < batch->height ? nr+1 : 0;
+        for (c = 0; c < batch->width; c++) {
+            nc = c+1 < batch->width ? c+1 : 0;
+            nnc = nc+1 < batch->width ? nc+1 : 0;
+
+            match3(batch->type[r][c], batch->type[r][nc],
+                   batch->type[r][nnc], set);
+            if ((lane = lanes(set))) {
+                mark3(batch->mark[r][c], batch->mark[r][nc],
+                      batch->mark[r][nnc], set);
+                found |= lane;
+            }
+
+            match3(batch->type[r][c], batch->type[nr][c],
+                   batch->type[nnr][c], set);
+            if ((lane = lanes(set))) {
+                mark3(batch->mark[r][c], batch->mark[nr][c],
+                      batch->mark[nnr][c], set);
+                found |= lane;
+            }
+        }
+    }
+    return found;
+}
+
+// bggame_remove_sets on every board; removed gets each one's count
+void bgbatch_remove_sets(bgbatch_t *batch, uint8_t *removed) {
+    int8_t r, c;
+    memset(removed, 0, BGBATCH_LANES);
+    for (r = 0; r < batch->height; r++)
+        for (c = 0; c < batch->width; c++)
+            clear_marked(batch->type[r][c], batch->mark[r][c], removed);
+    clear_marks(batch);
+}
+
+// bggame_compact_row on one lane
+static uint8_t compact_row(bgbatch_t *batch, int8_t r, int l) {
+    int8_t from, to;
+    for (from = 0, to = 0; from < batch->width; from++)
+        if (batch->type[r][from][l])
+            batch->type[r][to++][l] = batch->type[r][from][l];
+    for (from = to; from < batch->width; from++)
+        batch->type[r][from][l] = 0;
+    return batch->width-to;
+}
+
+// bggame_fill_spaces on every board; steps gets each one's result
+// (the rows slide one lane at a time, but the new pieces for every
+// lane come from one kernel call, in the order the game draws them)
+void bgbatch_fill_spaces(bgbatch_t *batch, uint8_t *steps) {
+    uint8_t count[MAX_HEIGHT][BGBATCH_LANES];
+    uint8_t active[BGBATCH_LANES], types[BGBATCH_LANES];
+    int8_t r, step, most = 0;
+    int l;
+    for (l = 0; l < BGBATCH_LANES; l++) {
+        steps[l] = 0;
+        for (r = 0; r < batch->height; r++) {
+            count[r][l] = compact_row(batch, r, l);
+            if (count[r][l] > steps[l])
+                steps[l] = count[r][l];
+        }
+        if (steps[l] > most)
+            most = steps[l];
+    }
+    for (step = 0; step < most; step++)
+        for (r = 0; r < batch->height; r++) {
+            for (l = 0; l < BGBATCH_LANES; l++)
+                active[l] = step < count[r][l] ? 0xFF : 0;
+            draw(batch->random, active, batch->variety, types);
+            for (l = 0; l < BGBATCH_LANES; l++)
+                if (active[l])
+                    batch->type[r][batch->width-count[r][l]+step][l] =
+                        types[l];
+        }
+}
@@ -0,0 +1,26 @@
+#ifndef __BGBATCH_H__
+#define __BGBATCH_H__
+
+// boards advanced together (one AVX2 register of bytes)
+#define BGBATCH_LANES 32
+
+// a batch of boards of one size and variety, stored lane-last, so
+// that the same cell of every board is one run of bytes
+typedef struct {
+    int8_t width, height, variety;
+    // piece type of each cell (0 is a space, 1 is 'a')
+    uint8_t type[MAX_HEIGHT][MAX_WIDTH][BGBATCH_LANES];
+    // 0xFF where the cell is in a set
+    uint8_t mark[MAX_HEIGHT][MAX_WIDTH][BGBATCH_LANES];
+    // each board's source of new pieces
+    nkrand_t random[BGBATCH_LANES];
+} bgbatch_t;
+
+const char *bgbatch_kernels();
+void bgbatch_load(bgbatch_t *batch, const game_t *games);
+void bgbatch_store(const bgbatch_t *batch, game_t *games);
+uint32_t bgbatch_mark_sets(bgbatch_t *batch);
+void bgbatch_remove_sets(bgbatch_t *batch, uint8_t *removed);
+void bgbatch_fill_spaces(bgbatch_t *batch, uint8_t *steps);
+
+#endif
@@ -0,0 +1,345 @@
+/* bgbench: host timings for the hot parts of blockgame */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <inttypes.h>
+
+#include "nkrand.h"
+
+#include "bggame.h"
+#include "bgbits.h"
+#include "bgpack.h"
+#include "bgpreset.h"
+#include "bgbatch.h"
+
+// boards in the corpus for each width/height/variety
+#define BOARDS 8
+// default number of passes over the corpus for each timing
+#define PASSES 200
+
+// limits of the start menu (see bgmenu_field_and_limits)
+#define MIN_WIDTH 10
+#define MIN_HEIGHT 3
+#define MIN_VARIETY 5
+#define MAX_VARIETY BGGAME_MAX_VARIETY
+
+typedef struct {
+    // fresh random boards, which may contain sets
+    game_t raw[BOARDS];
+    // raw boards with their sets marked
+    game_t marked[BOARDS];
+    // marked boards with their sets removed
+    game_t removed[BOARDS];
+    // boards cleared of sets, as play sees them
+    game_t cleared[BOARDS];
+} corpus_t;
+
+void build_corpus(corpus_t *corpus, int8_t width, int8_t height,
+                  int8_t variety);
+uint16_t corpus_seed(int8_t width, int8_t height, int8_t variety);
+double now_ns();
+void report(const char *function, game_t *game, long ops, double ns);
+void bench_config(corpus_t *corpus, int passes);
+uint8_t cascade(game_t *game);
+long avr_libc_rand(unsigned long *context);
+uint8_t mark_chars(const game_t *game, bgbits_row_t *marks);
+uint8_t vertical_chars(const game_t *game, bgbits_row_t *marks);
+uint32_t batch_cascade(bgbatch_t *batch);
+
+int main(int argc, char **argv) {
+    int8_t width, height, variety;
+    int passes = argc > 1 ? atoi(argv[1]) : PASSES;
+    corpus_t corpus;
+
+    fprintf(stderr, "bgbatch kernels: %s\n", bgbatch_kernels());
+    printf("function,width,height,variety,ops,ns_per_op,ops_per_sec\n");
+    for (width = MIN_WIDTH; width <= MAX_WIDTH; width++)
+        for (height = MIN_HEIGHT; height <= MAX_HEIGHT; height++)
+            for (variety = MIN_VARIETY; variety <= MAX_VARIETY; variety++) {
+                build_corpus(&corpus, width, height, variety);
+                bench_config(&corpus, passes);
+            }
+    return 0;
+}
+
+// BENCHMARKS
+
+void bench_config(corpus_t *corpus, int passes) {
+    static bgbatch_t batch, marked;
+    game_t game, *config = &corpus->raw[0];
+    game_t lanes[BGBATCH_LANES];
+    double start;
+    long ops = (long)passes*BOARDS;
+    long batch_passes = ops/BGBATCH_LANES;
+    int p, b;
+    uint8_t sink = 0;
+    bgbits_row_t marks[MAX_HEIGHT];
+    unsigned long context = 1;
+
+    // marking a marked board does the same work, so mark in place
+    start = now_ns();
+    for (p = 0; p < passes; p++)
+        for (b = 0; b < BOARDS; b++)
+            sink ^= bggame_mark_sets(&corpus->raw[b]);
+    report("mark_sets", config, ops, now_ns()-start);
+
+    // the same sets, found the way the game did before bitboards
+    start = now_ns();
+    for (p = 0; p < passes; p++)
+        for (b = 0; b < BOARDS; b++) {
+            memset(marks, 0, sizeof(marks));
+            sink ^= mark_chars(&corpus->raw[b], marks);
+        }
+    report("mark_chars", config, ops, now_ns()-start);
+
+    // vertical sets alone, from packed columns and from the board chars
+    // (mark_sets uses the packed columns when built with PACKED=1)
+    start = now_ns();
+    for (p = 0; p < passes; p++)
+        for (b = 0; b < BOARDS; b++) {
+            memset(marks, 0, sizeof(marks));
+            bgpack_vertical_sets(&corpus->raw[b], marks);
+            sink ^= marks[0];
+        }
+    report("vertical_swar", config, ops, now_ns()-start);
+
+    start = now_ns();
+    for (p = 0; p < passes; p++)
+        for (b = 0; b < BOARDS; b++) {
+            memset(marks, 0, sizeof(marks));
+            sink ^= vertical_chars(&corpus->raw[b], marks);
+        }
+    report("vertical_chars", config, ops, now_ns()-start);
+
+    start = now_ns();
+    for (p = 0; p < passes; p++)
+        for (b = 0; b < BOARDS; b++)
+            sink ^= bggame_valid_move_exists(&corpus->cleared[b]);
+    report("valid_move_exists", config, ops, now_ns()-start);
+
+    // the copy built for any size, to compare with a preset's copy
+    start = now_ns();
+    for (p = 0; p < passes; p++)
+        for (b = 0; b < BOARDS; b++)
+            sink ^= bgpreset_valid_move_exists_any(&corpus->cleared[b]);
+    report("valid_move_any", config, ops, now_ns()-start);
+
+    // timings that change the board work on a copy, so they also
+    // include copying one game_t
+    start = now_ns();
+    for (p = 0; p < passes; p++)
+        for (b = 0; b < BOARDS; b++) {
+            game = corpus->marked[b];
+            sink ^= bggame_remove_sets(&game);
+        }
+    report("remove_sets", config, ops, now_ns()-start);
+
+    // each copy carries the board's own random state, so every run
+    // refills with the same pieces
+    start = now_ns();
+    for (p = 0; p < passes; p++)
+        for (b = 0; b < BOARDS; b++) {
+            game = corpus->removed[b];
+            sink ^= bggame_fill_spaces(&game);
+        }
+    report("fill_spaces", config, ops, now_ns()-start);
+
+    start = now_ns();
+    for (p = 0; p < passes; p++)
+        for (b = 0; b < BOARDS; b++) {
+            game = corpus->marked[b];
+            sink ^= cascade(&game);
+        }
+    report("cascade", config, ops, now_ns()-start);
+
+    // a new game's board, from each corpus board's random state
+    start = now_ns();
+    for (p = 0; p < passes; p++)
+        for (b = 0; b < BOARDS; b++) {
+            game = corpus->raw[b];
+            bggame_deal(&game);
+            sink ^= game.random;
+        }
+    report("deal", config, ops, now_ns()-start);
+
+    // the same work on the corpus boards, a batch at a time
+    // (each timing still counts one op per board)
+    for (b = 0; b < BGBATCH_LANES; b++)
+        lanes[b] = corpus->raw[b % BOARDS];
+    bgbatch_load(&batch, lanes);
+    start = now_ns();
+    for (p = 0; p < batch_passes; p++)
+        sink ^= bgbatch_mark_sets(&batch);
+    report("batch_mark_sets", config, batch_passes*BGBATCH_LANES,
+           now_ns()-start);
+
+    for (b = 0; b < BGBATCH_LANES; b++)
+        lanes[b] = corpus->marked[b % BOARDS];
+    bgbatch_load(&marked, lanes);
+    start = now_ns();
+    for (p = 0; p < batch_passes; p++) {
+        batch = marked;
+        sink ^= batch_cascade(&batch);
+    }
+    report("batch_cascade", config, batch_passes*BGBATCH_LANES,
+           now_ns()-start);
+
+    // new pieces, against what avr-libc's rand() % variety costs
+    game = *config;
+    start = now_ns();
+    for (p = 0; p < passes; p++)
+        for (b = 0; b < BOARDS; b++)
+            sink ^= bggame_random_piece(&game);
+    report("random_piece", config, ops, now_ns()-start);
+
+    start = now_ns();
+    for (p = 0; p < passes; p++)
+        for (b = 0; b < BOARDS; b++)
+            sink ^= 'a'+(avr_libc_rand(&context) % config->variety);
+    report("avr_libc_rand_mod", config, ops, now_ns()-start);
+
+    // keep the compiler from dropping the calls
+    if (sink == 0xFF)
+        fprintf(stderr, "\n");
+}
+
+// UTILS
+
+// remove marked sets, refill, and repeat until no sets remain
+// (bggame_animate_clear_sets, without the display)
+uint8_t cascade(game_t *game) {
+    uint8_t combos = 1;
+    do {
+        game->score += (combos * bggame_remove_sets(game));
+        combos++;
+        while (bggame_fill_spaces(game));
+    } while (bggame_mark_sets(game));
+    return combos;
+}
+
+// cascade, for every board in a batch at once; boards that settle
+// early just sit out the remaining rounds
+uint32_t batch_cascade(bgbatch_t *batch) {
+    uint8_t removed[BGBATCH_LANES], steps[BGBATCH_LANES];
+    uint32_t rounds = 0;
+    do {
+        bgbatch_remove_sets(batch, removed);
+        bgbatch_fill_spaces(batch, steps);
+        rounds++;
+    } while (bgbatch_mark_sets(batch));
+    return rounds;
+}
+
+// the generator behind avr-libc's rand(): Park-Miller "minimal
+// standard", which needs a 32-bit division and remainder per call
+long avr_libc_rand(unsigned long *context) {
+    long hi, lo, x = *context;
+    if (x == 0)
+        x = 123459876L;
+    hi = x / 127773L;
+    lo = x % 127773L;
+    x = 16807L * lo - 2836L * hi;
+    if (x < 0)
+        x += 0x7fffffffL;
+    return ((*context = x) % 0x8000L);
+}
+
+// sets the way the game found them before bitboards: one pass over
+// the cells, comparing each with the next two across and down
+uint8_t mark_chars(const game_t *game, bgbits_row_t *marks) {
+    int8_t r, c, nr, nnr, nc, nnc;
+    uint8_t found = 0;
+    char piece;
+    for (r = 0; r < game->height; r++) {
+        nr = bggame_next_row(game, r);
+        nnr = bggame_next_row(game, nr);
+        for (c = 0; c < game->width; c++) {
+            nc = bggame_next_column(game, c);
+            nnc = bggame_next_column(game, nc);
+            piece = bggame_type(game, r, c);
+            if (!piece)
+                continue;
+            if (piece == bggame_type(game, r, nc) &&
+                piece == bggame_type(game, r, nnc)) {
+                marks[r] |= ((bgbits_row_t)1 << c) |
+                    ((bgbits_row_t)1 << nc) | ((bgbits_row_t)1 << nnc);
+                found = 1;
+            }
+            if (piece == bggame_type(game, nr, c) &&
+                piece == bggame_type(game, nnr, c)) {
+                marks[r] |= (bgbits_row_t)1 << c;
+                marks[nr] |= (bgbits_row_t)1 << c;
+                marks[nnr] |= (bgbits_row_t)1 << c;
+                found = 1;
+            }
+        }
+    }
+    return found;
+}
+
+// vertical sets the way the game found them before bitboards: three
+// loads and two compares per cell
+uint8_t vertical_chars(const game_t *game, bgbits_row_t *marks) {
+    int8_t r, c, nr, nnr;
+    uint8_t found = 0;
+    char piece;
+    for (r = 0; r < game->height; r++) {
+        nr = bggame_next_row(game, r);
+        nnr = bggame_next_row(game, nr);
+        for (c = 0; c < game->width; c++) {
+            piece = bggame_type(game, r, c);
+            if (piece &&
+                piece == bggame_type(game, nr, c) &&
+                piece == bggame_type(game, nnr, c)) {
+                marks[r] |= (bgbits_row_t)1 << c;
+                marks[nr] |= (bgbits_row_t)1 << c;
+                marks[nnr] |= (bgbits_row_t)1 << c;
+                found = 1;
+            }
+        }
+    }
+    return found;
+}
+
+// seed for a configuration's corpus, so every run times the same boards
+uint16_t corpus_seed(int8_t width, int8_t height, int8_t variety) {
+    return (width << 8) ^ (height << 5) ^ variety;
+}
+
+void build_corpus(corpus_t *corpus, int8_t width, int8_t height,
+                  int8_t variety) {
+    int b;
+    game_t *game;
+    for (b = 0; b < BOARDS; b++) {
+        game = &corpus->raw[b];
+        nkrand_start(&game->random, corpus_seed(width, height, variety)+b);
+        game->width = width;
+        game->height = height;
+        game->variety = variety;
+        game->score = 0;
+        bggame_board_init(game);
+        while (bggame_fill_spaces(game));
+
+        corpus->marked[b] = *game;
+        bggame_mark_sets(&corpus->marked[b]);
+        corpus->removed[b] = corpus->marked[b];
+        bggame_remove_sets(&corpus->removed[b]);
+        corpus->cleared[b] = corpus->marked[b];
+        cascade(&corpus->cleared[b]);
+    }
+}
+
+double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+void report(const char *function, game_t *game, long ops, double ns) {
+    printf("%s,%d,%d,%d,%ld,%.1f,%.0f\n",
+           function, game->width, game->height, game->variety,
+           ops, ns/ops, ops/(ns/1e9));
+}
@@ -0,0 +1,76 @@
+/* bggrade: reference scores from the solver, and how the hint does */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <inttypes.h>
+
+#include "nkrand.h"
+
+#include "bggame.h"
+#include "bgbits.h"
+#include "bghint.h"
+#include "bgsolve.h"
+
+// default boards per configuration, search time, and samples
+#define BOARDS 8
+#define BUDGET_MS 200
+// (sampled, because searching the board's own refills sees the
+// pieces coming, and scores above what any player could)
+#define SAMPLES 4
+// transposition table size (2^TABLE_BITS entries)
+#define TABLE_BITS 20
+
+// the configurations graded: the default and smallest boards, at
+// varieties where games last a while but do end
+const int8_t configs[][3] = {
+    { 10, 3, 7 }, { 10, 3, 9 }, { 20, 4, 9 }, { 20, 4, 11 }
+};
+
+int main(int argc, char **argv) {
+    int boards = argc > 1 ? atoi(argv[1]) : BOARDS;
+    double budget = argc > 2 ? atof(argv[2]) : BUDGET_MS;
+    int samples = argc > 3 ? atoi(argv[3]) : SAMPLES;
+    bgsolve_t solve;
+    bgsolve_result_t result;
+    bghint_t hint;
+    game_t game;
+    float hint_value;
+    int c, b;
+
+    if (!bgsolve_init(&solve, TABLE_BITS, samples, 1)) {
+        fprintf(stderr, "no room for the transposition table\n");
+        return 1;
+    }
+    printf("width,height,variety,seed,depth,nodes,hits,"
+           "best_value,hint_value,hint_grade\n");
+    for (c = 0; c < sizeof(configs)/sizeof(configs[0]); c++) {
+        bgsolve_clear(&solve);
+        for (b = 0; b < boards; b++) {
+            // dealt the way bggame_play deals, with a move ready
+            game.width = configs[c][0];
+            game.height = configs[c][1];
+            game.variety = configs[c][2];
+            game.score = 0;
+            nkrand_start(&game.random, b+1);
+            bggame_deal(&game);
+            bgsolve_search(&solve, &game, budget, BGSOLVE_MAX_DEPTH,
+                           &result);
+            if (result.depth == 0)
+                continue; // no time for one move
+
+            // the hint's move, valued as deep as the best one
+            bghint_reset(&hint);
+            bghint_step(&game, &hint, game.width*game.height);
+            hint_value = bgsolve_move(&solve, &game, hint.a, hint.b,
+                                      result.depth);
+            printf("%d,%d,%d,%d,%d,%ld,%ld,%.2f,%.2f,%.3f\n",
+                   game.width, game.height, game.variety, b+1,
+                   result.depth, result.nodes, result.hits,
+                   result.value, hint_value,
+                   result.value > 0 ? hint_value/result.value : 1.0);
+        }
+    }
+    bgsolve_free(&solve);
+    return 0;
+}
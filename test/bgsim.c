@@ -0,0 +1,418 @@
+/* bgsim: play seeded games on the host, to balance the board defaults */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <inttypes.h>
+
+#include "nkrand.h"
+
+#include "bggame.h"
+#include "bghint.h"
+
+// default number of games for each width/height/variety (every game
+// has its own seed, and a seed is 16 bits and never zero, since
+// nkrand_start treats zero as one, so at most 65535)
+#define GAMES 1024
+#define MAX_GAMES 65535
+// games handed out at a time; small enough for the threads to finish
+// together, big enough that taking a job is rare
+#define JOB_GAMES 64
+// games stop here, if the player never runs out of moves
+#define MOVE_LIMIT 500
+// longest cascade counted on its own (longer ones share the last slot)
+#define DEPTHS 8
+// points covered by each slot of the score histogram
+#define SCORE_BUCKET 64
+#define SCORE_BUCKETS 1024
+
+// limits of the start menu (see bgmenu_field_and_limits)
+#define MIN_WIDTH 10
+#define MIN_HEIGHT 3
+#define MIN_VARIETY 5
+
+// the scripted players
+#define P_SCAN 0 // the first valid move, from a random cell
+#define P_HINT 1 // the move bghint picks
+
+typedef struct {
+    int8_t width, height, variety;
+} config_t;
+
+// totals for one configuration, from one thread
+typedef struct {
+    uint32_t games;
+    // games stopped at MOVE_LIMIT
+    uint32_t capped;
+    // games by number of moves
+    uint32_t moves[MOVE_LIMIT+1];
+    // games by score, SCORE_BUCKET points per slot
+    uint32_t scores[SCORE_BUCKETS];
+    uint64_t score_sum;
+    // moves by the number of rounds of sets they removed
+    uint32_t depths[DEPTHS+1];
+} stats_t;
+
+// games first to first+count-1 of configuration config
+typedef struct {
+    int config;
+    int first, count;
+} job_t;
+
+// one thread's jobs: it takes from the bottom, and others steal
+// from the top once theirs run out
+typedef struct {
+    pthread_mutex_t lock;
+    job_t *jobs;
+    int top, bottom;
+} deque_t;
+
+typedef struct sim sim_t;
+
+typedef struct {
+    sim_t *sim;
+    int index;
+    pthread_t thread;
+    deque_t deque;
+    // one stats_t per configuration
+    stats_t *stats;
+    long games, steals;
+} worker_t;
+
+struct sim {
+    config_t *configs;
+    int config_count;
+    worker_t *workers;
+    int worker_count;
+    int player;
+};
+
+int build_configs(config_t **configs);
+void build_jobs(sim_t *sim, int games);
+void *worker_run(void *arg);
+int take_job(worker_t *worker, job_t *job);
+int steal_job(worker_t *worker, job_t *job);
+void play_game(const config_t *config, int player, uint16_t seed,
+               stats_t *stats);
+uint8_t pick_move(game_t *game, int player, nkrand_t *random,
+                  point_t *a, point_t *b);
+uint8_t cascade(game_t *game, uint32_t *score);
+void merge_stats(stats_t *into, const stats_t *from);
+int percentile(const uint32_t *counts, int slots, uint32_t total, int pct);
+void report(const config_t *config, const stats_t *stats);
+double now_ns();
+
+int main(int argc, char **argv) {
+    int games = argc > 1 ? atoi(argv[1]) : GAMES;
+    int threads = argc > 2 ? atoi(argv[2]) : sysconf(_SC_NPROCESSORS_ONLN);
+    sim_t sim;
+    stats_t total;
+    double start;
+    long played = 0, steals = 0;
+    int c, w;
+
+    sim.player = argc > 3 && strcmp(argv[3], "hint") == 0 ? P_HINT : P_SCAN;
+    if (games < 1 || games > MAX_GAMES || threads < 1) {
+        fprintf(stderr, "usage: bgsim [games 1-%d] [threads] [scan|hint]\n",
+                MAX_GAMES);
+        return 1;
+    }
+
+    sim.config_count = build_configs(&sim.configs);
+    sim.worker_count = threads;
+    sim.workers = calloc(threads, sizeof(worker_t));
+    for (w = 0; w < threads; w++) {
+        sim.workers[w].sim = &sim;
+        sim.workers[w].index = w;
+        sim.workers[w].stats = calloc(sim.config_count, sizeof(stats_t));
+        pthread_mutex_init(&sim.workers[w].deque.lock, NULL);
+    }
+    build_jobs(&sim, games);
+
+    start = now_ns();
+    for (w = 0; w < threads; w++)
+        pthread_create(&sim.workers[w].thread, NULL, worker_run,
+                       &sim.workers[w]);
+    for (w = 0; w < threads; w++) {
+        pthread_join(sim.workers[w].thread, NULL);
+        played += sim.workers[w].games;
+        steals += sim.workers[w].steals;
+    }
+
+    // every game lands in the same totals whichever thread played it,
+    // so the report is the same for any number of threads
+    printf("width,height,variety,games,capped_pct,"
+           "moves_mean,moves_p10,moves_p50,moves_p90,"
+           "score_mean,score_p10,score_p50,score_p90,"
+           "cascade_mean,cascade_1_pct,cascade_2_pct,cascade_3_pct,"
+           "cascade_4plus_pct,cascade_max\n");
+    for (c = 0; c < sim.config_count; c++) {
+        memset(&total, 0, sizeof(total));
+        for (w = 0; w < threads; w++)
+            merge_stats(&total, &sim.workers[w].stats[c]);
+        report(&sim.configs[c], &total);
+    }
+    fprintf(stderr, "%ld games on %d threads in %.1fs (%.0f games/s, "
+            "%ld steals)\n", played, threads, (now_ns()-start)/1e9,
+            played/((now_ns()-start)/1e9), steals);
+    return 0;
+}
+
+// SIMULATION
+
+// deal a game, then let the player make moves until none are left
+void play_game(const config_t *config, int player, uint16_t seed,
+               stats_t *stats) {
+    game_t game;
+    nkrand_t random;
+    point_t a, b;
+    uint32_t score = 0, moves = 0;
+    uint8_t depth;
+
+    game.width = config->width;
+    game.height = config->height;
+    game.variety = config->variety;
+    game.score = 0;
+    nkrand_start(&game.random, seed);
+    // the player's choices come from their own sequence, so they
+    // don't change which pieces are dealt
+    nkrand_start(&random, ~seed);
+
+    // dealt the way bggame_play deals, with a move ready
+    bggame_deal(&game);
+
+    while (moves < MOVE_LIMIT &&
+           pick_move(&game, player, &random, &a, &b)) {
+        bggame_swap_pieces(&game, a, b);
+        bggame_mark_sets(&game);
+        depth = cascade(&game, &score);
+        stats->depths[depth < DEPTHS ? depth : DEPTHS]++;
+        moves++;
+    }
+    if (moves == MOVE_LIMIT)
+        stats->capped++;
+
+    stats->games++;
+    stats->moves[moves]++;
+    stats->scores[score/SCORE_BUCKET < SCORE_BUCKETS ?
+                  score/SCORE_BUCKET : SCORE_BUCKETS-1]++;
+    stats->score_sum += score;
+}
+
+// choose the player's next move; returns false if there is none
+uint8_t pick_move(game_t *game, int player, nkrand_t *random,
+                  point_t *a, point_t *b) {
+    bghint_t hint;
+    int cells = game->width*game->height;
+    int start, i;
+
+    if (player == P_HINT) {
+        bghint_reset(&hint);
+        bghint_step(game, &hint, cells);
+        *a = hint.a;
+        *b = hint.b;
+        return hint.score != 0;
+    }
+
+    // a person doesn't always start looking at the top left
+    start = nkrand_next(random) % cells;
+    for (i = 0; i < cells; i++) {
+        a->row = ((start+i) % cells) / game->width;
+        a->column = ((start+i) % cells) % game->width;
+        *b = *a;
+        b->column = bggame_next_column(game, a->column);
+        if (bggame_valid_move(game, *a, *b))
+            return 1;
+        *b = *a;
+        b->row = bggame_next_row(game, a->row);
+        if (bggame_valid_move(game, *a, *b))
+            return 1;
+    }
+    return 0;
+}
+
+// remove marked sets, refill, and repeat until no sets remain
+// (bggame_animate_clear_sets, without the display); returns the
+// number of rounds
+uint8_t cascade(game_t *game, uint32_t *score) {
+    uint8_t combos = 0;
+    do {
+        combos++;
+        *score += combos * bggame_remove_sets(game);
+        // one pass refills every space (its result only counts the
+        // animation steps, which the simulation doesn't draw)
+        bggame_fill_spaces(game);
+    } while (bggame_mark_sets(game));
+    return combos;
+}
+
+// THREADS
+
+// play jobs, from this thread's deque and then from others', until
+// there are none left anywhere
+void *worker_run(void *arg) {
+    worker_t *worker = (worker_t*)arg;
+    const sim_t *sim = worker->sim;
+    job_t job;
+    int g;
+    while (take_job(worker, &job) || steal_job(worker, &job)) {
+        for (g = job.first; g < job.first+job.count; g++)
+            play_game(&sim->configs[job.config], sim->player, g+1,
+                      &worker->stats[job.config]);
+        worker->games += job.count;
+    }
+    return NULL;
+}
+
+// take the job at the bottom of this thread's own deque
+int take_job(worker_t *worker, job_t *job) {
+    deque_t *deque = &worker->deque;
+    int taken = 0;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->top < deque->bottom) {
+        *job = deque->jobs[--deque->bottom];
+        taken = 1;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return taken;
+}
+
+// take the job at the top of the next thread's deque that has one
+// (jobs never make more jobs, so once every deque has been found
+// empty the sweep is done)
+int steal_job(worker_t *worker, job_t *job) {
+    const sim_t *sim = worker->sim;
+    deque_t *deque;
+    int i, taken = 0;
+    for (i = 1; i < sim->worker_count && !taken; i++) {
+        deque = &sim->workers[(worker->index+i) % sim->worker_count].deque;
+        pthread_mutex_lock(&deque->lock);
+        if (deque->top < deque->bottom) {
+            *job = deque->jobs[deque->top++];
+            taken = 1;
+        }
+        pthread_mutex_unlock(&deque->lock);
+    }
+    worker->steals += taken;
+    return taken;
+}
+
+// split every configuration's games into jobs, and deal them out
+// to the threads in turn
+void build_jobs(sim_t *sim, int games) {
+    int per_config = (games+JOB_GAMES-1)/JOB_GAMES;
+    int jobs = sim->config_count*per_config;
+    int c, j, n = 0;
+    deque_t *deque;
+    job_t job;
+
+    for (n = 0; n < sim->worker_count; n++) {
+        deque = &sim->workers[n].deque;
+        deque->jobs = calloc(jobs/sim->worker_count+1, sizeof(job_t));
+        deque->top = deque->bottom = 0;
+    }
+    // configurations are dealt in order, so each thread starts with
+    // a mix of small and large boards
+    for (n = 0, c = 0; c < sim->config_count; c++)
+        for (j = 0; j < per_config; j++, n++) {
+            job.config = c;
+            job.first = j*JOB_GAMES;
+            job.count = games-job.first < JOB_GAMES ?
+                games-job.first : JOB_GAMES;
+            deque = &sim->workers[n % sim->worker_count].deque;
+            deque->jobs[deque->bottom++] = job;
+        }
+}
+
+// UTILS
+
+// every configuration the start menu allows
+int build_configs(config_t **configs) {
+    int8_t width, height, variety;
+    int count = 0;
+    *configs = calloc((MAX_WIDTH-MIN_WIDTH+1)*(MAX_HEIGHT-MIN_HEIGHT+1)*
+                      (BGGAME_MAX_VARIETY-MIN_VARIETY+1), sizeof(config_t));
+    for (width = MIN_WIDTH; width <= MAX_WIDTH; width++)
+        for (height = MIN_HEIGHT; height <= MAX_HEIGHT; height++)
+            for (variety = MIN_VARIETY; variety <= BGGAME_MAX_VARIETY;
+                 variety++) {
+                (*configs)[count].width = width;
+                (*configs)[count].height = height;
+                (*configs)[count].variety = variety;
+                count++;
+            }
+    return count;
+}
+
+void merge_stats(stats_t *into, const stats_t *from) {
+    int i;
+    into->games += from->games;
+    into->capped += from->capped;
+    for (i = 0; i <= MOVE_LIMIT; i++)
+        into->moves[i] += from->moves[i];
+    for (i = 0; i < SCORE_BUCKETS; i++)
+        into->scores[i] += from->scores[i];
+    into->score_sum += from->score_sum;
+    for (i = 0; i <= DEPTHS; i++)
+        into->depths[i] += from->depths[i];
+}
+
+// the slot that holds the pct'th percentile of a histogram
+int percentile(const uint32_t *counts, int slots, uint32_t total, int pct) {
+    uint64_t seen = 0;
+    int i;
+    for (i = 0; i < slots-1; i++) {
+        seen += counts[i];
+        if (seen*100 >= (uint64_t)total*pct)
+            break;
+    }
+    return i;
+}
+
+void report(const config_t *config, const stats_t *stats) {
+    uint64_t moves = 0, move_sum = 0, depth_sum = 0;
+    int i, deepest = 0;
+    for (i = 0; i <= MOVE_LIMIT; i++)
+        move_sum += (uint64_t)i*stats->moves[i];
+    for (i = 1; i <= DEPTHS; i++) {
+        moves += stats->depths[i];
+        depth_sum += (uint64_t)i*stats->depths[i];
+        if (stats->depths[i])
+            deepest = i;
+    }
+    if (moves == 0)
+        moves = 1; // no moves made at all
+    // scores are the bottom of their slot (within SCORE_BUCKET)
+    printf("%d,%d,%d,%u,%.2f,%.1f,%d,%d,%d,%.1f,%d,%d,%d,"
+           "%.3f,%.2f,%.2f,%.2f,%.2f,%s%d\n",
+           config->width, config->height, config->variety, stats->games,
+           100.0*stats->capped/stats->games,
+           (double)move_sum/stats->games,
+           percentile(stats->moves, MOVE_LIMIT+1, stats->games, 10),
+           percentile(stats->moves, MOVE_LIMIT+1, stats->games, 50),
+           percentile(stats->moves, MOVE_LIMIT+1, stats->games, 90),
+           (double)stats->score_sum/stats->games,
+           SCORE_BUCKET*percentile(stats->scores, SCORE_BUCKETS,
+                                   stats->games, 10),
+           SCORE_BUCKET*percentile(stats->scores, SCORE_BUCKETS,
+                                   stats->games, 50),
+           SCORE_BUCKET*percentile(stats->scores, SCORE_BUCKETS,
+                                   stats->games, 90),
+           (double)depth_sum/moves,
+           100.0*stats->depths[1]/moves,
+           100.0*stats->depths[2]/moves,
+           100.0*stats->depths[3]/moves,
+           100.0*(moves-stats->depths[1]-stats->depths[2]-
+                  stats->depths[3])/moves,
+           deepest == DEPTHS ? ">=" : "", deepest);
+}
+
+double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e9 + ts.tv_nsec;
+}
@@ -0,0 +1,221 @@
+/* bgsolve: expectimax search over swaps, for reference scores */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <inttypes.h>
+
+#include "nkrand.h"
+
+#include "bggame.h"
+#include "bgbits.h"
+#include "bgsolve.h"
+
+static double now_ns();
+static uint64_t next_key(uint64_t *state);
+static uint8_t swap_at(const game_t *game, int i, point_t *a, point_t *b);
+
+// make the random keys and an empty table of 2^bits entries;
+// returns false if the table can't be had
+int bgsolve_init(bgsolve_t *solve, int bits, int samples, uint32_t seed) {
+    uint64_t state = seed;
+    int r, c, t;
+    for (r = 0; r < MAX_HEIGHT; r++)
+        for (c = 0; c < MAX_WIDTH; c++)
+            for (t = 0; t < BGBITS_TYPES; t++)
+                solve->cells[r][c][t] = next_key(&state);
+    for (t = 0; t <= BGSOLVE_MAX_DEPTH; t++)
+        solve->depths[t] = next_key(&state);
+    for (t = 0; t < 256; t++) {
+        solve->random[0][t] = next_key(&state);
+        solve->random[1][t] = next_key(&state);
+    }
+    solve->mask = (1u << bits)-1;
+    solve->table = calloc(solve->mask+1, sizeof(bgsolve_entry_t));
+    solve->samples = samples;
+    solve->nodes = solve->hits = 0;
+    solve->deadline = 0;
+    solve->timed_out = 0;
+    return solve->table != NULL;
+}
+
+void bgsolve_free(bgsolve_t *solve) {
+    free(solve->table);
+    solve->table = NULL;
+}
+
+// forget every remembered position (the table holds one board
+// configuration's positions at a time)
+void bgsolve_clear(bgsolve_t *solve) {
+    memset(solve->table, 0, (solve->mask+1)*sizeof(bgsolve_entry_t));
+}
+
+// Zobrist hash of the board (and of the random state, when the
+// search uses the board's own refills)
+uint64_t bgsolve_hash(const bgsolve_t *solve, const game_t *game) {
+    uint64_t key = 0;
+    int8_t r, c;
+    for (r = 0; r < game->height; r++)
+        for (c = 0; c < game->width; c++)
+            key ^= solve->cells[r][c][bggame_type(game, r, c)];
+    if (solve->samples == 0)
+        key ^= solve->random[0][game->random & 0xFF] ^
+            solve->random[1][game->random >> 8];
+    return key;
+}
+
+// make a valid move, and clear the sets and cascades it causes the
+// way bggame_select and bggame_animate_clear_sets do; returns the
+// points scored
+uint16_t bgsolve_play(game_t *game, point_t a, point_t b) {
+    uint16_t points = 0;
+    uint8_t combos = 1;
+    bggame_swap_pieces(game, a, b);
+    while (bggame_mark_sets(game)) {
+        points += combos++ * bggame_remove_sets(game);
+        bggame_fill_spaces(game);
+    }
+    return points;
+}
+
+// chance node: the points expected from swapping a and b, and from
+// the best depth-1 moves after it
+float bgsolve_move(bgsolve_t *solve, const game_t *game,
+                   point_t a, point_t b, int8_t depth) {
+    game_t play;
+    uint64_t key = 0;
+    float total = 0;
+    int s, samples = solve->samples ? solve->samples : 1;
+    if (solve->samples)
+        key = bgsolve_hash(solve, game);
+    for (s = 0; s < samples; s++) {
+        play = *game;
+        // each sample's refills come from a seed fixed by the
+        // position, so a search can be repeated exactly
+        if (solve->samples)
+            nkrand_start(&play.random,
+                         (uint16_t)(key >> ((s % 4)*16)) ^ s);
+        total += bgsolve_play(&play, a, b);
+        if (depth > 1)
+            total += bgsolve_value(solve, &play, depth-1);
+    }
+    return total/samples;
+}
+
+// max node: the points expected from the best depth moves
+// (0 once no move is left)
+float bgsolve_value(bgsolve_t *solve, const game_t *game, int8_t depth) {
+    bgsolve_entry_t *entry;
+    uint64_t key;
+    point_t a, b;
+    float value, best = 0;
+    int i;
+
+    if (depth <= 0 || solve->timed_out)
+        return 0;
+    if (solve->deadline && (solve->nodes & 0xFF) == 0 &&
+        now_ns() > solve->deadline) {
+        solve->timed_out = 1;
+        return 0;
+    }
+    solve->nodes++;
+
+    key = bgsolve_hash(solve, game) ^ solve->depths[depth];
+    entry = &solve->table[key & solve->mask];
+    if (entry->depth == depth && entry->key == key) {
+        solve->hits++;
+        return entry->value;
+    }
+
+    for (i = 0; i < 2*game->width*game->height; i++)
+        if (swap_at(game, i, &a, &b)) {
+            value = bgsolve_move(solve, game, a, b, depth);
+            if (value > best)
+                best = value;
+        }
+
+    // a search cut short has no true value to remember; otherwise
+    // deeper results win the slot
+    if (!solve->timed_out && entry->depth <= depth) {
+        entry->key = key;
+        entry->value = best;
+        entry->depth = depth;
+    }
+    return best;
+}
+
+// search one move deeper at a time until max_depth, or until
+// budget_ms have passed (0 is no limit); result holds the best move
+// of the deepest search that finished
+void bgsolve_search(bgsolve_t *solve, const game_t *game,
+                    double budget_ms, int8_t max_depth,
+                    bgsolve_result_t *result) {
+    point_t a, b, best_a, best_b;
+    float value, best;
+    int8_t depth;
+    int i;
+
+    solve->nodes = solve->hits = 0;
+    solve->timed_out = 0;
+    solve->deadline = budget_ms > 0 ? now_ns()+budget_ms*1e6 : 0;
+    if (max_depth > BGSOLVE_MAX_DEPTH)
+        max_depth = BGSOLVE_MAX_DEPTH;
+    result->depth = 0;
+    result->value = 0;
+
+    for (depth = 1; depth <= max_depth; depth++) {
+        best = -1;
+        for (i = 0; i < 2*game->width*game->height; i++)
+            if (swap_at(game, i, &a, &b)) {
+                value = bgsolve_move(solve, game, a, b, depth);
+                if (solve->timed_out)
+                    break;
+                if (value > best) {
+                    best = value;
+                    best_a = a;
+                    best_b = b;
+                }
+            }
+        // no move at all, or out of time part way through (a move
+        // from a search that didn't finish may not be the best)
+        if (best < 0 || solve->timed_out)
+            break;
+        result->a = best_a;
+        result->b = best_b;
+        result->value = best;
+        result->depth = depth;
+    }
+    result->nodes = solve->nodes;
+    result->hits = solve->hits;
+    // later calls (to value other moves) run to the end
+    solve->deadline = 0;
+    solve->timed_out = 0;
+}
+
+// swap i of the board (each cell with its right, then below,
+// neighbor, as bghint_step visits them); returns true if it is valid
+static uint8_t swap_at(const game_t *game, int i, point_t *a, point_t *b) {
+    a->row = (i >> 1) / game->width;
+    a->column = (i >> 1) % game->width;
+    *b = *a;
+    if (i & 1)
+        b->row = bggame_next_row(game, a->row);
+    else
+        b->column = bggame_next_column(game, a->column);
+    return bggame_valid_move(game, *a, *b);
+}
+
+// splitmix64, to fill the key tables
+static uint64_t next_key(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e9 + ts.tv_nsec;
+}
@@ -0,0 +1,56 @@
+#ifndef __BGSOLVE_H__
+#define __BGSOLVE_H__
+
+// deepest search iterative deepening will try
+#define BGSOLVE_MAX_DEPTH 16
+
+// one remembered position
+typedef struct {
+    uint64_t key;
+    float value;
+    // moves searched below this position (0 is empty)
+    int8_t depth;
+} bgsolve_entry_t;
+
+typedef struct {
+    // random keys for each piece type in each cell, for each depth,
+    // and for the random state (when refills are known)
+    uint64_t cells[MAX_HEIGHT][MAX_WIDTH][BGBITS_TYPES];
+    uint64_t depths[BGSOLVE_MAX_DEPTH+1];
+    uint64_t random[2][256];
+    // transposition table, 2^bits entries
+    bgsolve_entry_t *table;
+    uint32_t mask;
+    // refills sampled at each chance node; 0 uses the board's own
+    // random state, so the search sees the pieces that really come
+    int samples;
+    // search counters
+    long nodes, hits;
+    // give up on the current search at this time (0 is never)
+    double deadline;
+    uint8_t timed_out;
+} bgsolve_t;
+
+// the outcome of a search
+typedef struct {
+    point_t a, b;
+    // expected points from the best move on, over depth moves
+    float value;
+    // the deepest search that finished (0 if none did)
+    int8_t depth;
+    long nodes, hits;
+} bgsolve_result_t;
+
+int bgsolve_init(bgsolve_t *solve, int bits, int samples, uint32_t seed);
+void bgsolve_free(bgsolve_t *solve);
+void bgsolve_clear(bgsolve_t *solve);
+uint64_t bgsolve_hash(const bgsolve_t *solve, const game_t *game);
+uint16_t bgsolve_play(game_t *game, point_t a, point_t b);
+float bgsolve_move(bgsolve_t *solve, const game_t *game,
+                   point_t a, point_t b, int8_t depth);
+float bgsolve_value(bgsolve_t *solve, const game_t *game, int8_t depth);
+void bgsolve_search(bgsolve_t *solve, const game_t *game,
+                    double budget_ms, int8_t max_depth,
+                    bgsolve_result_t *result);
+
+#endif
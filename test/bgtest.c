@@ -1,10 +1,29 @@
 /* bgtest: unit tests for parts of blockgame */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <inttypes.h>
+#include <avr/pgmspace.h>
+
+#include "lcd.h"
+
+#include "nklcd.h"
+#include "nkbuttons.h"
+#include "nkeeprom.h"
+#include "nkrand.h"
+#include "nktimer.h"
+#include "nkprof.h"
 
 #include "bggame.h"
+#include "bghint.h"
+#include "bgbits.h"
+#include "bgpreset.h"
+#include "bgpack.h"
+#include "bgbatch.h"
+#include "bgsolve.h"
+#include "bghighscore.h"
 
 #define PASS 0
 #define FAIL 1
@@ -26,14 +45,111 @@
     }
 
 void print_game(game_t);
+void random_game(game_t *game, int8_t width, int8_t height, int8_t variety);
+uint8_t reference_valid_move(game_t game, point_t a, point_t b);
+void reference_vertical_sets(const game_t *game, bgbits_row_t *marks);
+void reference_horizontal_sets(const game_t *game, bgbits_row_t *marks);
+uint8_t reference_fill_step(game_t *game);
+uint8_t same_rows(char (*a)[MAX_WIDTH], char (*b)[MAX_WIDTH],
+                  const game_t *game);
+uint8_t same_board(const game_t *a, const game_t *b);
+void load_game(game_t *game, int8_t width, int8_t height, int8_t variety,
+               const char *pieces);
+void put_ring_record(nkeeprom_ring_t *ring, int8_t slot,
+                     const char *payload, uint8_t sequence);
+void store_save(nkeeprom_tables_t *tables, uint16_t key, const char *text);
+uint8_t store_holds(nkeeprom_tables_t *tables, uint16_t key,
+                    const char *text);
+uint8_t migrate_torn(const game_t *game, const unsigned char *expect);
+void drain_queue();
 int valid_move_test_SIMPLE();
 int valid_move_test_BITTEST();
+int mark_sets_test_WRAP();
+int mark_sets_test_NONE();
+int valid_move_test_RANDOM();
+int write_board_test_SHADOW();
+int hint_test_SIMPLE();
+int hint_test_STEPS();
+int random_test_REPEAT();
+int random_test_RANGE();
+int fill_test_FRAMES();
+int queue_test_DRAIN();
+int queue_test_FULL();
+int buttons_test_EDGES();
+int crc_test_CHECK();
+int preset_test_MATCH();
+int pack_test_VERTICAL();
+int pack_test_SHORT();
+int board_test_LIMITS();
+int batch_test_MATCH();
+int solve_test_SIMPLE();
+int solve_test_DEADLINE();
+int deal_test_READY();
+int timer_test_OVERRUN();
+int timer_test_TASKS();
+int ring_test_NEWEST();
+int eeprom_test_ASYNC();
+int store_test_WRAP();
+int store_test_EVICT();
+int store_test_TORN();
+int highscore_test_MIGRATE();
+int prof_test_TOTALS();
+int preset_match(game_t *game,
+                 uint8_t (*find_sets)(const game_t*, bgbits_row_t*),
+                 uint8_t (*valid_move_exists)(const game_t*),
+                 uint8_t (*fill_spaces)(game_t*));
+
+// the display queue's interrupt handler (see mock/avr/interrupt.h)
+void TIMER2_COMPA_vect();
+// the buttons' pin change handler
+void PCINT1_vect();
+// the animation timer's handler
+void TIMER0_COMPA_vect();
+// the table the high score screen shows
+extern bghighscore_t highscores[HIGH_SCORES];
+// the profiler's overflow handler
+void TIMER1_OVF_vect();
 
 int main() {
     int pass = PASS;
     printf("Beginning tests...\n");
     TEST(valid_move_test_SIMPLE);
+#if BGGAME_MAX_VARIETY > 16
+    // (a board packed in four bits can't tell 'a' from 'q')
     TEST(valid_move_test_BITTEST);
+#endif
+    TEST(mark_sets_test_WRAP);
+    TEST(mark_sets_test_NONE);
+    TEST(valid_move_test_RANDOM);
+    TEST(write_board_test_SHADOW);
+    TEST(hint_test_SIMPLE);
+    TEST(hint_test_STEPS);
+    TEST(random_test_REPEAT);
+    TEST(random_test_RANGE);
+    TEST(fill_test_FRAMES);
+    TEST(queue_test_DRAIN);
+    TEST(queue_test_FULL);
+    TEST(buttons_test_EDGES);
+    TEST(crc_test_CHECK);
+    TEST(preset_test_MATCH);
+    TEST(pack_test_VERTICAL);
+    TEST(pack_test_SHORT);
+    TEST(board_test_LIMITS);
+    TEST(batch_test_MATCH);
+    TEST(solve_test_SIMPLE);
+    TEST(solve_test_DEADLINE);
+    TEST(deal_test_READY);
+    TEST(timer_test_OVERRUN);
+    TEST(timer_test_TASKS);
+    TEST(ring_test_NEWEST);
+    TEST(eeprom_test_ASYNC);
+    TEST(store_test_WRAP);
+    TEST(store_test_EVICT);
+    TEST(store_test_TORN);
+    TEST(highscore_test_MIGRATE);
+#ifdef NKPROF
+    TEST(prof_test_TOTALS);
+#endif
     printf("Tests finished: %s\n", pass == PASS ? "PASS" : "FAIL");
     return pass;
 }
@@ -41,44 +157,1237 @@ int main() {
 // TESTS
 
 int valid_move_test_SIMPLE() {
-    game_t game = {.width=3,
-                   .height=3,
-                   .variety=9,
-                   .board={ {'a', 'b', 'c'},
-                            {'a', 'd', 'e'},
-                            {'f', 'a', 'z'} }
-    };
+    game_t game;
+    load_game(&game, 3, 3, 9, "abc"
+                              "ade"
+                              "fai");
 
     //SIMPLE has a valid move (move 'a' in lower middle to the left)
-    ASSERT_GAME(bggame_valid_move_exists(game), game);
+    ASSERT_GAME(bggame_valid_move_exists(&game), game);
     return PASS;
 }
 
 int valid_move_test_BITTEST() {
-    game_t game = {.width=3,
-                   .height=3,
-                   .variety=9,
-                   .board={ {'a', 'b', 'c'},
-                            {'a', 'd', 'e'},
-                            {'f', 'q', 'z'} }
-    };
+    game_t game;
+    load_game(&game, 3, 3, 9, "abc"
+                              "ade"
+                              "fqi");
 
     // BITTEST has no valid move ('a' is now 'q')
     // this test captures a bug that bggame_match has:
     // comparing only four bits of the character, not five
-    ASSERT_GAME(!bggame_valid_move_exists(game), game);
+    ASSERT_GAME(!bggame_valid_move_exists(&game), game);
+    return PASS;
+}
+
+int mark_sets_test_WRAP() {
+    game_t game;
+    // marked pieces, one bit per column (column 0 is the lowest bit)
+    bgbits_row_t marked[MAX_HEIGHT] = { 0x1B,   // A E . A A
+                                        0x02,   // . E . . .
+                                        0x00,   // . . . . .
+                                        0x02 }; // . E . . .
+    load_game(&game, 5, 4, 5, "aecaa"
+                              "bedcb"
+                              "dcbec"
+                              "cedbd");
+
+    // WRAP has a horizontal set across the right edge of the top row,
+    // and a vertical set across the bottom edge of the second column
+    ASSERT_GAME(bggame_mark_sets(&game), game);
+    ASSERT_GAME(memcmp(game.marks, marked, sizeof(marked)) == 0, game);
+    // and removes the six pieces in them
+    ASSERT_GAME(bggame_remove_sets(&game) == 6, game);
+    ASSERT_GAME(bggame_piece(&game, 0, 2) == 'c' &&
+                bggame_piece(&game, 0, 3) == ' ', game);
+    return PASS;
+}
+
+int mark_sets_test_NONE() {
+    game_t game, unmarked;
+    load_game(&game, 3, 3, 9, "abc"
+                              "ade"
+                              "fai");
+    unmarked = game;
+
+    // NONE has no sets, and marking must leave it untouched
+    ASSERT_GAME(!bggame_mark_sets(&game), game);
+    ASSERT_GAME(memcmp(game.board, unmarked.board, sizeof(game.board)) == 0,
+                game);
+    return PASS;
+}
+
+int valid_move_test_RANDOM() {
+    game_t game;
+    point_t check, right, below;
+    int i;
+
+    srand(1);
+    for (i = 0; i < 500; i++) {
+        random_game(&game, 10+(i % 11), 3+(i % 2), 5+(i % (BGGAME_MAX_VARIETY-4)));
+        // every swap must get the same answer as marking the whole board
+        for (check.row = 0; check.row < game.height; check.row++) {
+            for (check.column = 0;
+                 check.column < game.width;
+                 check.column++) {
+                right = below = check;
+                right.column = bggame_next_column(&game, check.column);
+                below.row = bggame_next_row(&game, check.row);
+                ASSERT_GAME(bggame_valid_move(&game, check, right) ==
+                            reference_valid_move(game, check, right),
+                            game);
+                ASSERT_GAME(bggame_valid_move(&game, check, below) ==
+                            reference_valid_move(game, check, below),
+                            game);
+            }
+        }
+    }
+    return PASS;
+}
+
+int write_board_test_SHADOW() {
+    game_t game;
+    srand(2);
+    random_game(&game, NKLCD_COLUMNS, NKLCD_ROWS, 5);
+
+    // the first write sends every piece; rows 0 and 2 and rows 1 and 3
+    // are consecutive in display memory, so only two gotos are needed
+    nklcd_clear();
+    mock_lcd_gotos = mock_lcd_writes = 0;
+    bggame_write_board(&game);
+    ASSERT_GAME(mock_lcd_writes == game.width*game.height, game);
+    ASSERT_GAME(mock_lcd_gotos == 2, game);
+
+    // nothing changed, so nothing is sent
+    mock_lcd_gotos = mock_lcd_writes = 0;
+    bggame_write_board(&game);
+    ASSERT_GAME(mock_lcd_writes == 0 && mock_lcd_gotos == 0, game);
+
+    // a changed run is sent with one goto
+    bggame_put(&game, 1, 4, ' ');
+    bggame_put(&game, 1, 5, ' ');
+    mock_lcd_gotos = mock_lcd_writes = 0;
+    bggame_write_board(&game);
+    ASSERT_GAME(mock_lcd_writes == 2 && mock_lcd_gotos == 1, game);
+    return PASS;
+}
+
+int hint_test_SIMPLE() {
+    game_t game;
+    bghint_t hint;
+    load_game(&game, 3, 3, 9, "abc"
+                              "ade"
+                              "fai");
+
+    // SIMPLE's only move swaps the bottom-left 'f' and 'a',
+    // which removes three pieces and causes no cascade
+    bghint_reset(&hint);
+    bghint_step(&game, &hint, game.width*game.height);
+    ASSERT_GAME(bghint_done(&game, &hint), game);
+    ASSERT_GAME(hint.score == 3, game);
+    ASSERT_GAME(hint.a.row == 2 && hint.a.column == 0, game);
+    ASSERT_GAME(hint.b.row == 2 && hint.b.column == 1, game);
+    return PASS;
+}
+
+int hint_test_STEPS() {
+    game_t game;
+    bghint_t once, steps;
+    int i;
+
+    srand(3);
+    for (i = 0; i < 50; i++) {
+        random_game(&game, 10+(i % 11), 3+(i % 2), 5+(i % 4));
+        // searching in one go and one cell at a time find the same move
+        bghint_reset(&once);
+        bghint_step(&game, &once, game.width*game.height);
+        bghint_reset(&steps);
+        while (!bghint_done(&game, &steps))
+            bghint_step(&game, &steps, 1);
+        ASSERT_GAME(once.score == steps.score, game);
+        ASSERT_GAME((once.score != 0) == bggame_valid_move_exists(&game),
+                    game);
+        if (once.score) {
+            ASSERT_GAME(once.a.row == steps.a.row &&
+                        once.a.column == steps.a.column &&
+                        once.b.row == steps.b.row &&
+                        once.b.column == steps.b.column, game);
+            ASSERT_GAME(bggame_valid_move(&game, once.a, once.b), game);
+        }
+    }
+    return PASS;
+}
+
+int random_test_REPEAT() {
+    game_t game, again;
+    int i;
+
+    srand(4);
+    for (i = 0; i < 20; i++) {
+        random_game(&game, 20, 4, 5+(i % (BGGAME_MAX_VARIETY-4)));
+        // the same seed refills the same removed pieces the same way
+        bggame_put(&game, 0, 3, ' ');
+        bggame_put(&game, 2, 0, ' ');
+        bggame_put(&game, 2, 19, ' ');
+        again = game;
+        while (bggame_fill_spaces(&game));
+        while (bggame_fill_spaces(&again));
+        ASSERT_GAME(memcmp(game.board, again.board,
+                           sizeof(game.board)) == 0, again);
+    }
+    return PASS;
+}
+
+int random_test_RANGE() {
+    nkrand_t random;
+    uint8_t n, r, seen[26];
+    int i;
+
+    // xorshift is stuck at zero, so a zero seed must not start there
+    nkrand_start(&random, 0);
+    if (nkrand_next(&random) == 0) {
+        printf("nkrand_start(0) is stuck\n");
+        return FAIL;
+    }
+
+    for (n = 5; n <= 26; n++) {
+        // every value below n turns up, and nothing else does
+        memset(seen, 0, sizeof(seen));
+        for (i = 0; i < 1000; i++) {
+            r = nkrand_below(&random, n);
+            if (r >= n) {
+                printf("nkrand_below(%d) = %d\n", n, r);
+                return FAIL;
+            }
+            seen[r] = 1;
+        }
+        for (i = 0; i < n; i++)
+            if (!seen[i]) {
+                printf("nkrand_below(%d) never gave %d\n", n, i);
+                return FAIL;
+            }
+    }
+    return PASS;
+}
+
+int fill_test_FRAMES() {
+    game_t game, reference;
+    fill_t fill;
+    char frame[MAX_HEIGHT][MAX_WIDTH];
+    int i, c;
+
+    srand(6);
+    for (i = 0; i < 200; i++) {
+        random_game(&game, 10+(i % 11), 3+(i % 2), 5+(i % (BGGAME_MAX_VARIETY-4)));
+        // knock out pieces in runs of up to the whole row
+        for (c = 0; c < game.width; c++)
+            if (rand() % 3 == 0 || i % 50 == 0)
+                bggame_put(&game, rand() % game.height, c, ' ');
+        reference = game;
+
+        // every frame matches refilling one space per row at a time
+        bggame_fill_start(&game, &fill);
+        while (fill.step < fill.steps) {
+            ASSERT_GAME(reference_fill_step(&reference), reference);
+            bggame_fill_step(&game, &fill);
+            bggame_read_rows(&reference, frame);
+            ASSERT_GAME(same_rows(fill.frame, frame, &game), reference);
+        }
+        ASSERT_GAME(!reference_fill_step(&reference), reference);
+        ASSERT_GAME(same_board(&game, &reference), game);
+    }
+    return PASS;
+}
+
+int queue_test_DRAIN() {
+    game_t game;
+    int ticks;
+    srand(9);
+    random_game(&game, NKLCD_COLUMNS, NKLCD_ROWS, 5);
+
+    // queued writes return without touching the display
+    nklcd_queue_start();
+    nklcd_clear();
+    mock_lcd_gotos = mock_lcd_writes = mock_lcd_nibbles = 0;
+    nklcd_write_cell(2, 3, 'q');
+    ASSERT_GAME(mock_lcd_nibbles == 0, game);
+
+    // the clear holds the queue, then the goto and the piece go out
+    // as two nibbles each
+    for (ticks = 0; ticks < 2*NKLCD_CLEAR_TICKS; ticks++)
+        TIMER2_COMPA_vect();
+    ASSERT_GAME(mock_lcd_nibbles == 3*2, game);
+    ASSERT_GAME(mock_lcd_gotos == 0 && mock_lcd_writes == 0, game);
+    nklcd_queue_stop();
+    return PASS;
+}
+
+int queue_test_FULL() {
+    char first[NKLCD_ROWS][NKLCD_COLUMNS], next[NKLCD_ROWS][NKLCD_COLUMNS];
+    int ticks, r, c;
+    srand(25);
+    for (r = 0; r < NKLCD_ROWS; r++)
+        for (c = 0; c < NKLCD_COLUMNS; c++) {
+            first[r][c] = 'a' + rand() % 5;
+            next[r][c] = 'a' + rand() % 5;
+        }
+    nklcd_queue_start();
+    nklcd_clear();
+    drain_queue();
+
+    // a whole screen of new pieces doesn't fit in the queue, but the
+    // writes still return without waiting for the display (the mock
+    // interrupt only runs when a test calls it)
+    nklcd_write_grid(&first[0][0], NKLCD_COLUMNS, NKLCD_ROWS, NKLCD_COLUMNS);
+    if (!nklcd_dirty_cells())
+        return FAIL;
+    // and so do the next screen, and the cursor, part way through
+    for (ticks = 0; ticks < 50; ticks++)
+        TIMER2_COMPA_vect();
+    nklcd_write_grid(&next[0][0], NKLCD_COLUMNS, NKLCD_ROWS, NKLCD_COLUMNS);
+    nklcd_write_cell(1, 4, 'Q');
+    next[1][4] = 'Q';
+    nklcd_goto_position(2, 7);
+
+    // the interrupt catches the display up, and leaves it at the
+    // cursor
+    drain_queue();
+    for (r = 0; r < NKLCD_ROWS; r++)
+        for (c = 0; c < NKLCD_COLUMNS; c++)
+            if (mock_lcd_ram[nklcd_address(r, c)] != next[r][c])
+                return FAIL;
+    if (mock_lcd_cursor != nklcd_address(2, 7))
+        return FAIL;
+    nklcd_queue_stop();
+    return PASS;
+}
+
+int buttons_test_EDGES() {
+    nkbuttons_t state;
+    int ticks;
+    // buttons pull their pins low
+    PINC = 0xFF;
+    nkbuttons_init();
+    nkbuttons_clear(&state);
+
+    // a press is read as soon as its edge arrives
+    PINC &= ~B_LEFT;
+    PCINT1_vect();
+    if (nkbuttons_read(&state) != B_LEFT || state.stable != B_LEFT)
+        return FAIL;
+
+    // bounces during the lockout are ignored
+    PINC |= B_LEFT;
+    PCINT1_vect();
+    PINC &= ~B_LEFT;
+    PCINT1_vect();
+    if (nkbuttons_read(&state) != 0)
+        return FAIL;
+
+    // held down, it repeats after the first delay, then faster
+    for (ticks = 0; ticks <= NKBUTTONS_REPEAT_FIRST; ticks++)
+        nkbuttons_tick();
+    if (nkbuttons_read(&state) != B_LEFT)
+        return FAIL;
+    for (ticks = 0; ticks < NKBUTTONS_REPEAT; ticks++)
+        nkbuttons_tick();
+    if (nkbuttons_read(&state) != 0)
+        return FAIL;
+    nkbuttons_tick();
+    if (nkbuttons_read(&state) != B_LEFT)
+        return FAIL;
+
+    // a release during the lockout is picked up when it ends
+    PINC |= B_LEFT;
+    PCINT1_vect();
+    PINC &= ~B_UP;
+    PCINT1_vect();
+    PINC |= B_UP;
+    PCINT1_vect();
+    for (ticks = 0; ticks < NKBUTTONS_LOCKOUT; ticks++)
+        nkbuttons_tick();
+    if (nkbuttons_read(&state) != B_UP || state.stable != 0)
+        return FAIL;
+    return PASS;
+}
+
+int crc_test_CHECK() {
+    unsigned char check[] = "123456789";
+    uint8_t crc;
+    // the standard check value for CRC-8 with polynomial 0x07
+    if (nkeeprom_crc8(0, check, 9) != 0xF4)
+        return FAIL;
+    // a CRC can be built up a piece at a time
+    crc = nkeeprom_crc8(0, check, 4);
+    if (nkeeprom_crc8(crc, check+4, 5) != 0xF4)
+        return FAIL;
+    return PASS;
+}
+
+int preset_test_MATCH() {
+    game_t game;
+    int i;
+    srand(16);
+    for (i = 0; i < 100; i++) {
+        // boards straight from the generator, so some have sets
+        game.width = 20;
+        game.height = 4;
+        game.variety = 5;
+        nkrand_start(&game.random, rand());
+        bggame_board_init(&game);
+        bggame_fill_spaces(&game);
+#ifdef BGPRESET_20X4
+        if (!preset_match(&game,
+                          bgpreset_find_sets_20x4,
+                          bgpreset_valid_move_exists_20x4,
+                          bgpreset_fill_spaces_20x4))
+            return FAIL;
+#endif
+
+        random_game(&game, 10, 3, 5);
+#ifdef BGPRESET_10X3
+        if (!preset_match(&game,
+                          bgpreset_find_sets_10x3,
+                          bgpreset_valid_move_exists_10x3,
+                          bgpreset_fill_spaces_10x3))
+            return FAIL;
+#endif
+    }
+    return PASS;
+}
+
+int pack_test_VERTICAL() {
+    game_t game;
+    bgbits_row_t marks[MAX_HEIGHT], expect[MAX_HEIGHT];
+    int i, r;
+    srand(18);
+    for (i = 0; i < 200; i++) {
+        // unsettled boards, with a column of spaces, in both heights
+        game.width = 10+(i % 11);
+        game.height = 3+(i & 1);
+        game.variety = 5;
+        nkrand_start(&game.random, rand());
+        bggame_board_init(&game);
+        bggame_fill_spaces(&game);
+        for (r = 0; r < game.height; r++)
+            bggame_put(&game, r, i % game.width, ' ');
+
+        memset(marks, 0, sizeof(marks));
+        memset(expect, 0, sizeof(expect));
+        bgpack_vertical_sets(&game, marks);
+        reference_vertical_sets(&game, expect);
+        for (r = 0; r < game.height; r++)
+            ASSERT_GAME(marks[r] == expect[r], game);
+    }
+    return PASS;
+}
+
+int pack_test_SHORT() {
+    game_t game;
+    bgbits_row_t marks[MAX_HEIGHT], expect[MAX_HEIGHT];
+    int i, r;
+    srand(24);
+    for (i = 0; i < 200; i++) {
+        // boards of one and two rows, where a vertical set wraps
+        // around onto rows it already covers; few types, so there
+        // are plenty of sets
+        game.width = 3+(i % (MAX_WIDTH-2));
+        game.height = 1+(i & 1);
+        game.variety = 3;
+        nkrand_start(&game.random, rand());
+        bggame_board_init(&game);
+        bggame_fill_spaces(&game);
+        bggame_put(&game, 0, i % game.width, ' ');
+
+        // the packed columns agree with the wrapped rows
+        memset(marks, 0, sizeof(marks));
+        memset(expect, 0, sizeof(expect));
+        bgpack_vertical_sets(&game, marks);
+        reference_vertical_sets(&game, expect);
+        for (r = 0; r < game.height; r++)
+            ASSERT_GAME(marks[r] == expect[r], game);
+
+        // and so does whichever the build finds sets with
+        reference_horizontal_sets(&game, expect);
+        ASSERT_GAME(bgpreset_find_sets_any(&game, marks) ==
+                    (expect[0] || expect[game.height-1]), game);
+        for (r = 0; r < game.height; r++)
+            ASSERT_GAME(marks[r] == expect[r], game);
+    }
+    return PASS;
+}
+
+int board_test_LIMITS() {
+    game_t game;
+    char expect[MAX_HEIGHT][MAX_WIDTH];
+    point_t check, below;
+    int i, r, c;
+    srand(19);
+    for (i = 0; i < 20; i++) {
+        // every cell of the largest board holds what was put there,
+        // however the board is stored
+        game.width = MAX_WIDTH;
+        game.height = MAX_HEIGHT;
+        game.variety = BGGAME_MAX_VARIETY;
+        nkrand_start(&game.random, rand());
+        bggame_board_init(&game);
+        for (r = 0; r < MAX_HEIGHT; r++)
+            for (c = 0; c < MAX_WIDTH; c++) {
+                expect[r][c] = rand() % 4 ? bggame_random_piece(&game) : ' ';
+                bggame_put(&game, r, c, expect[r][c]);
+            }
+        for (r = 0; r < MAX_HEIGHT; r++)
+            for (c = 0; c < MAX_WIDTH; c++)
+                ASSERT_GAME(bggame_piece(&game, r, c) == expect[r][c], game);
+
+        // and plays like a small one, across both edges
+        random_game(&game, MAX_WIDTH, MAX_HEIGHT, 5);
+        check.row = MAX_HEIGHT-1;
+        for (check.column = 0; check.column < game.width; check.column++) {
+            below = check;
+            below.row = bggame_next_row(&game, check.row);
+            ASSERT_GAME(bggame_valid_move(&game, check, below) ==
+                        reference_valid_move(game, check, below), game);
+        }
+    }
+    return PASS;
+}
+
+int batch_test_MATCH() {
+    static bgbatch_t batch;
+    game_t games[BGBATCH_LANES], lanes[BGBATCH_LANES];
+    uint8_t removed[BGBATCH_LANES], steps[BGBATCH_LANES];
+    uint32_t found;
+    int i, l, r, round;
+    srand(21);
+    for (i = 0; i < 40; i++) {
+        // unsettled boards, so the first rounds have sets to remove
+        for (l = 0; l < BGBATCH_LANES; l++) {
+            games[l].width = 10+(i % 11);
+            games[l].height = 3+(i & 1);
+            games[l].variety = 5+(i % 4);
+            nkrand_start(&games[l].random, rand());
+            bggame_board_init(&games[l]);
+            bggame_fill_spaces(&games[l]);
+        }
+        bgbatch_load(&batch, games);
+
+        // every lane follows its own board through the cascade,
+        // step for step
+        for (round = 0; round < 8; round++) {
+            found = bgbatch_mark_sets(&batch);
+            for (l = 0; l < BGBATCH_LANES; l++)
+                ASSERT_GAME(bggame_mark_sets(&games[l]) ==
+                            ((found >> l) & 1), games[l]);
+            bgbatch_store(&batch, lanes);
+            for (l = 0; l < BGBATCH_LANES; l++)
+                for (r = 0; r < games[l].height; r++)
+                    ASSERT_GAME(lanes[l].marks[r] == games[l].marks[r],
+                                games[l]);
+
+            bgbatch_remove_sets(&batch, removed);
+            bgbatch_fill_spaces(&batch, steps);
+            bgbatch_store(&batch, lanes);
+            for (l = 0; l < BGBATCH_LANES; l++) {
+                ASSERT_GAME(bggame_remove_sets(&games[l]) == removed[l],
+                            games[l]);
+                ASSERT_GAME(bggame_fill_spaces(&games[l]) == steps[l],
+                            games[l]);
+                ASSERT_GAME(same_board(&lanes[l], &games[l]), lanes[l]);
+                ASSERT_GAME(lanes[l].random == games[l].random, lanes[l]);
+            }
+        }
+    }
+    return PASS;
+}
+
+int solve_test_SIMPLE() {
+    game_t game, play;
+    bgsolve_t solve;
+    bgsolve_result_t result;
+    point_t a = {2, 0, 0}, b = {2, 1, 0};
+    uint64_t hash;
+    float value;
+    load_game(&game, 3, 3, 9, "abc"
+                              "ade"
+                              "fai");
+    nkrand_start(&game.random, 22);
+    if (!bgsolve_init(&solve, 12, 0, 22))
+        return FAIL;
+
+    // the hash follows the board, and swapping back restores it
+    hash = bgsolve_hash(&solve, &game);
+    play = game;
+    bggame_swap_pieces(&play, a, b);
+    ASSERT_GAME(bgsolve_hash(&solve, &play) != hash, play);
+    bggame_swap_pieces(&play, a, b);
+    ASSERT_GAME(bgsolve_hash(&solve, &play) == hash, play);
+
+    // SIMPLE's only move is worth what playing it scores, so one
+    // move deep the search must pick it, with the seed's real refills
+    play = game;
+    bgsolve_search(&solve, &game, 0, 1, &result);
+    ASSERT_GAME(result.depth == 1, game);
+    ASSERT_GAME(result.a.row == 2 && result.a.column == 0 &&
+                result.b.row == 2 && result.b.column == 1, game);
+    ASSERT_GAME(result.value == bgsolve_play(&play, a, b), play);
+
+    // deeper searches can only add points, and searching again
+    // finds the positions remembered from the first time
+    bgsolve_search(&solve, &game, 0, 3, &result);
+    ASSERT_GAME(result.depth == 3 && result.value >= 3, game);
+    value = result.value;
+    bgsolve_search(&solve, &game, 0, 3, &result);
+    ASSERT_GAME(result.value == value && result.hits > 0, game);
+    bgsolve_free(&solve);
     return PASS;
 }
 
+int solve_test_DEADLINE() {
+    game_t game;
+    bgsolve_t solve;
+    bgsolve_result_t result;
+    int i;
+    if (!bgsolve_init(&solve, 16, 4, 22))
+        return FAIL;
+
+    // a search that runs out of time part way through a depth still
+    // answers with the move, and value, of the last depth it finished
+    for (i = 0; i < 5; i++) {
+        game.width = 20;
+        game.height = 4;
+        game.variety = 7;
+        game.score = 0;
+        nkrand_start(&game.random, i+1);
+        bggame_deal(&game);
+        bgsolve_clear(&solve);
+        bgsolve_search(&solve, &game, 2, BGSOLVE_MAX_DEPTH, &result);
+        if (result.depth == 0)
+            continue;
+        ASSERT_GAME(result.depth < BGSOLVE_MAX_DEPTH, game);
+        ASSERT_GAME(bgsolve_move(&solve, &game, result.a, result.b,
+                                 result.depth) == result.value, game);
+    }
+    bgsolve_free(&solve);
+    return PASS;
+}
+
+int deal_test_READY() {
+    game_t game, again;
+    int i, r, c;
+    srand(23);
+    for (i = 0; i < 300; i++) {
+        game.width = 10+(i % 11);
+        game.height = 3+(i & 1);
+        game.variety = 5+(i % (BGGAME_MAX_VARIETY-4));
+        nkrand_start(&game.random, rand());
+        again = game;
+
+        // a dealt board is full, has no sets, and has a move
+        bggame_deal(&game);
+        for (r = 0; r < game.height; r++)
+            for (c = 0; c < game.width; c++)
+                ASSERT_GAME(bggame_type(&game, r, c) != 0, game);
+        ASSERT_GAME(!bggame_mark_sets(&game), game);
+        ASSERT_GAME(bggame_valid_move_exists(&game), game);
+
+        // and the same seed deals the same board
+        bggame_deal(&again);
+        ASSERT_GAME(same_board(&game, &again), again);
+    }
+    return PASS;
+}
+
+// a frame that takes five ticks, run until it has been run runs times
+int16_t slow_frame_task(void *state) {
+    int *runs = (int*)state;
+    int ticks;
+    for (ticks = 0; ticks < 5; ticks++)
+        TIMER0_COMPA_vect();
+    return --*runs > 0 ? 2 : 0;
+}
+
+int timer_test_OVERRUN() {
+    nktimer_frames_t before;
+    uint16_t start;
+    int runs = 4;
+    nktimer_screen(NKTIMER_GAME);
+    before = nktimer_frames[NKTIMER_GAME];
+
+    // no tick, no frame
+    if (nktimer_animate() != 0)
+        return FAIL;
+    // one tick is a frame on time
+    TIMER0_COMPA_vect();
+    if (nktimer_animate() != 1 ||
+        nktimer_frames[NKTIMER_GAME].frames != before.frames+1 ||
+        nktimer_frames[NKTIMER_GAME].overruns != before.overruns)
+        return FAIL;
+    // three ticks are a frame that overran by two, and are reported
+    // to the caller instead of collapsing into one
+    TIMER0_COMPA_vect();
+    TIMER0_COMPA_vect();
+    TIMER0_COMPA_vect();
+    if (nktimer_wait() != 3 ||
+        nktimer_frames[NKTIMER_GAME].overruns != before.overruns+2)
+        return FAIL;
+
+    // a task whose frames run long catches up: the ticks a run
+    // overran by come off its next wait, so four runs after the first
+    // tick take only their own twenty ticks, and wait three times
+    start = nktimer_now();
+    TIMER0_COMPA_vect();
+    nktimer_run(slow_frame_task, &runs, 1);
+    if (runs != 0 || (uint16_t)(nktimer_now() - start) != 1+4*5 ||
+        nktimer_frames[NKTIMER_GAME].frames != before.frames+5)
+        return FAIL;
+    return PASS;
+}
+
+typedef struct {
+    // runs left, and whether a run started inside another
+    int runs;
+    uint8_t inside, reentered;
+    // runs of the nested task, left to go
+    int nested;
+} tick_task_t;
+
+// a frame that takes a tick, run every tick until it has been run
+// runs times
+int16_t tick_task(void *state) {
+    tick_task_t *tick = (tick_task_t*)state;
+    TIMER0_COMPA_vect();
+    return --tick->runs > 0;
+}
+
+// a frame that takes a tick, and on its second run waits for
+// another task, the way a screen waits for an animation
+int16_t nesting_task(void *state) {
+    tick_task_t *tick = (tick_task_t*)state;
+    tick_task_t nested;
+    TIMER0_COMPA_vect();
+    if (tick->inside)
+        tick->reentered = 1;
+    tick->inside = 1;
+    if (tick->runs == 3) {
+        nested.runs = 3;
+        nktimer_run(tick_task, &nested, 1);
+        tick->nested = nested.runs;
+    }
+    tick->inside = 0;
+    return --tick->runs > 0;
+}
+
+// counts its runs, every tick, forever
+int16_t count_task(void *state) {
+    (*(int*)state)++;
+    return 1;
+}
+
+int timer_test_TASKS() {
+    tick_task_t tick = { 4, 0, 0, -1 };
+    int counted = 0;
+    int8_t counter;
+    uint16_t start;
+
+    // a task in the table runs on every tick that goes by, beside
+    // the one being run, and beside the one that one waits for; the
+    // waiting task isn't run again until its wait is over
+    nktimer_screen(NKTIMER_GAME);
+    start = nktimer_now();
+    counter = nktimer_add(count_task, &counted, 1);
+    TIMER0_COMPA_vect();
+    nktimer_run(nesting_task, &tick, 1);
+    nktimer_remove(counter);
+    if (tick.runs != 0 || tick.reentered || tick.nested != 0)
+        return FAIL;
+    // (the last run took the last tick, after the counter's run)
+    if (counted != (uint16_t)(nktimer_now() - start)-1)
+        return FAIL;
+
+    // a removed task runs no more
+    counted = 0;
+    tick.runs = 2;
+    TIMER0_COMPA_vect();
+    nktimer_run(tick_task, &tick, 1);
+    if (counted != 0)
+        return FAIL;
+    return PASS;
+}
+
+int ring_test_NEWEST() {
+    nkeeprom_ring_t ring;
+    unsigned char read[6];
+    mock_eeprom_erase();
+    nkeeprom_ring_init(&ring, 16, 4, 5);
+
+    // erased memory holds no record, and neither does zeroed memory
+    if (nkeeprom_ring_read(&ring, read))
+        return FAIL;
+    memset(mock_eeprom, 0, sizeof(mock_eeprom));
+    if (nkeeprom_ring_read(&ring, read))
+        return FAIL;
+
+    // the newest record is found across the sequence number's wrap
+    put_ring_record(&ring, 0, "apple", 254);
+    put_ring_record(&ring, 1, "berry", 255);
+    put_ring_record(&ring, 2, "cherr", 0);
+    read[5] = 0;
+    if (!nkeeprom_ring_read(&ring, read) || ring.newest != 2 ||
+        strcmp((char*)read, "cherr") != 0)
+        return FAIL;
+
+    // a record torn part way through its payload fails its check
+    // byte, and the one before it is read instead
+    mock_eeprom[nkeeprom_ring_address(&ring, 2)+1] ^= 0x10;
+    if (!nkeeprom_ring_read(&ring, read) || ring.newest != 1 ||
+        strcmp((char*)read, "berry") != 0)
+        return FAIL;
+
+    // as does one whose sequence number didn't get written (the
+    // sequence is covered by the check byte)
+    put_ring_record(&ring, 3, "grape", 1);
+    mock_eeprom[nkeeprom_ring_address(&ring, 3)+6] = 0;
+    if (!nkeeprom_ring_read(&ring, read) || ring.newest != 1)
+        return FAIL;
+    return PASS;
+}
+
+int eeprom_test_ASYNC() {
+    unsigned char first = '1', second = '2';
+    mock_eeprom_erase();
+    memcpy(&mock_eeprom[40], "abXdeYg", 7);
+
+    // a queued write returns before anything is written
+    nkeeprom_write_async((unsigned char*)"abcdefg", 40, 7);
+    if (mock_eeprom_writes != 0 || mock_eeprom[42] != 'X')
+        return FAIL;
+    // then the interrupt writes only the bytes that differ
+    nkeeprom_wait();
+    if (memcmp(&mock_eeprom[40], "abcdefg", 7) != 0 ||
+        mock_eeprom_writes != 2 || nkeeprom_busy())
+        return FAIL;
+
+    // jobs go out in the order they were queued
+    nkeeprom_write_async(&first, 60, 1);
+    nkeeprom_write_async(&second, 60, 1);
+    nkeeprom_wait();
+    if (mock_eeprom[60] != '2' || mock_eeprom_writes != 4)
+        return FAIL;
+    // and reads wait for them
+    nkeeprom_write_async(&first, 61, 1);
+    if (nkeeprom_read_byte(61) != '1')
+        return FAIL;
+    return PASS;
+}
+
+int store_test_WRAP() {
+    nkeeprom_tables_t tables;
+    int i;
+    mock_eeprom_erase();
+    nkeeprom_tables_init(&tables, 0, 9, 4, 5);
+    if (nkeeprom_tables_formatted(&tables))
+        return FAIL;
+    nkeeprom_tables_format(&tables);
+
+    // a key saved once keeps its only record while more than 128
+    // saves of other keys go by, and is still the newest copy once
+    // saved again, before and after a reboot
+    store_save(&tables, 1, "old 1");
+    for (i = 0; i < 150; i++)
+        store_save(&tables, 2+(i & 1), i & 1 ? "three" : "two  ");
+    store_save(&tables, 1, "new 1");
+    if (!store_holds(&tables, 1, "new 1"))
+        return FAIL;
+    nkeeprom_tables_init(&tables, 0, 9, 4, 5);
+    if (!store_holds(&tables, 1, "new 1") || tables.sequence != 152)
+        return FAIL;
+    // and later saves replace the stale copy, not the new one
+    store_save(&tables, 2, "two 2");
+    store_save(&tables, 3, "thre3");
+    if (!store_holds(&tables, 1, "new 1"))
+        return FAIL;
+
+    // the newest copies are still found across the counter's wrap
+    // (starting near it, rather than after 65536 saves)
+    nkeeprom_tables_format(&tables);
+    tables.sequence = 0xFFF0;
+    store_save(&tables, 1, "one  ");
+    for (i = 0; i < 20; i++)
+        store_save(&tables, 2+(i & 1), i & 1 ? "three" : "two  ");
+    store_save(&tables, 2, "two 2");
+    nkeeprom_tables_init(&tables, 0, 9, 4, 5);
+    if (!store_holds(&tables, 1, "one  ") ||
+        !store_holds(&tables, 2, "two 2") ||
+        !store_holds(&tables, 3, "three") || tables.sequence != 6)
+        return FAIL;
+    return PASS;
+}
+
+int store_test_EVICT() {
+    nkeeprom_tables_t tables;
+    mock_eeprom_erase();
+    nkeeprom_tables_init(&tables, 0, 9, 4, 5);
+    nkeeprom_tables_format(&tables);
+
+    // with every slot taken by a different key, a new key replaces
+    // the one saved longest ago
+    store_save(&tables, 1, "one  ");
+    store_save(&tables, 2, "two  ");
+    store_save(&tables, 3, "three");
+    store_save(&tables, 4, "four ");
+    store_save(&tables, 1, "one 2");
+    store_save(&tables, 5, "five ");
+    nkeeprom_tables_init(&tables, 0, 9, 4, 5);
+    if (nkeeprom_tables_find(&tables, 2) >= 0 ||
+        !store_holds(&tables, 1, "one 2") ||
+        !store_holds(&tables, 3, "three") ||
+        !store_holds(&tables, 4, "four ") ||
+        !store_holds(&tables, 5, "five "))
+        return FAIL;
+    return PASS;
+}
+
+int store_test_TORN() {
+    nkeeprom_tables_t tables;
+    int budget;
+    // a save cut short anywhere (new bytes: five of record, one of
+    // CRC, and the two of its entry that change) leaves the last one
+    for (budget = 0; budget < 5+1+2; budget++) {
+        mock_eeprom_erase();
+        nkeeprom_tables_init(&tables, 0, 9, 4, 5);
+        nkeeprom_tables_format(&tables);
+        store_save(&tables, 1, "saved");
+        store_save(&tables, 2, "other");
+        mock_eeprom_budget = budget;
+        store_save(&tables, 1, "later");
+        mock_eeprom_budget = -1;
+        nkeeprom_tables_init(&tables, 0, 9, 4, 5);
+        if (!store_holds(&tables, 1, "saved") ||
+            !store_holds(&tables, 2, "other"))
+            return FAIL;
+    }
+    // and one that finishes counts
+    store_save(&tables, 1, "later");
+    nkeeprom_tables_init(&tables, 0, 9, 4, 5);
+    if (!store_holds(&tables, 1, "later"))
+        return FAIL;
+    return PASS;
+}
+
+int highscore_test_MIGRATE() {
+    game_t game;
+    nkeeprom_ring_t ring;
+    unsigned char *table = (unsigned char*)highscores;
+    unsigned char legacy[BGHIGHSCORE_BYTES], x = 0;
+    int i;
+    game.width = 20;
+    game.height = 4;
+    game.variety = 5;
+
+    // the first version's table, with its checksum after it
+    mock_eeprom_erase();
+    for (i = 0; i < HIGH_SCORES; i++) {
+        memcpy(highscores[i].initials, "abc", INITIALS);
+        highscores[i].initials[0] += i;
+        highscores[i].score = 100-i;
+    }
+    memcpy(legacy, table, BGHIGHSCORE_BYTES);
+    for (i = 0; i < BGHIGHSCORE_BYTES; i++)
+        x ^= legacy[i];
+    memcpy(&mock_eeprom[BGHIGHSCORE_LEGACY], legacy, BGHIGHSCORE_BYTES);
+    mock_eeprom[BGHIGHSCORE_LEGACY+BGHIGHSCORE_BYTES] = x;
+
+    // carries over to the store, for the starting configuration
+    bghighscore_clear();
+    bghighscore_init(&game);
+    if (memcmp(table, legacy, BGHIGHSCORE_BYTES) != 0)
+        return FAIL;
+    bghighscore_clear();
+    bghighscore_init(&game);
+    if (memcmp(table, legacy, BGHIGHSCORE_BYTES) != 0 ||
+        mock_eeprom[BGHIGHSCORE_TABLES+2] != BGHIGHSCORE_VERSION)
+        return FAIL;
+
+    // the ring's newest table wins over the first version's
+    mock_eeprom_erase();
+    memcpy(&mock_eeprom[BGHIGHSCORE_LEGACY], legacy, BGHIGHSCORE_BYTES);
+    mock_eeprom[BGHIGHSCORE_LEGACY+BGHIGHSCORE_BYTES] = x;
+    nkeeprom_ring_init(&ring, BGHIGHSCORE_RING, BGHIGHSCORE_RING_SLOTS,
+                       BGHIGHSCORE_BYTES);
+    highscores[0].score = 500;
+    put_ring_record(&ring, 0, (char*)table, 7);
+    highscores[0].score = 900;
+    put_ring_record(&ring, 1, (char*)table, 8);
+    bghighscore_clear();
+    bghighscore_init(&game);
+    if (highscores[0].score != 900 || highscores[1].score != 99)
+        return FAIL;
+
+    // a reset anywhere in the move to the store loses nothing, from
+    // the first version
+    mock_eeprom_erase();
+    memcpy(&mock_eeprom[BGHIGHSCORE_LEGACY], legacy, BGHIGHSCORE_BYTES);
+    mock_eeprom[BGHIGHSCORE_LEGACY+BGHIGHSCORE_BYTES] = x;
+    if (!migrate_torn(&game, legacy))
+        return FAIL;
+    // or from a ring whose newest record sits where the store's
+    // first record goes
+    mock_eeprom_erase();
+    memcpy(table, legacy, BGHIGHSCORE_BYTES);
+    highscores[0].score = 700;
+    put_ring_record(&ring, 5, (char*)table, 3);
+    if (!migrate_torn(&game, table))
+        return FAIL;
+
+    // and an EEPROM with nothing valid starts with an empty table
+    mock_eeprom_erase();
+    bghighscore_init(&game);
+    if (highscores[0].score != 0 || highscores[0].initials[0] != 'a')
+        return FAIL;
+    return PASS;
+}
+
+#ifdef NKPROF
+int prof_test_TOTALS() {
+    game_t game;
+    load_game(&game, 3, 3, 9, "abc"
+                              "ade"
+                              "fai");
+    nkprof_reset();
+    TIFR1 = 0;
+
+    // a region called from inside itself is timed once, from the
+    // outermost call
+    TCNT1 = 100;
+    nkprof_start(NKPROF_LCD);
+    TCNT1 = 350;
+    nkprof_start(NKPROF_LCD);
+    TCNT1 = 400;
+    nkprof_stop(NKPROF_LCD);
+    TCNT1 = 500;
+    nkprof_stop(NKPROF_LCD);
+    ASSERT_GAME(nkprof_totals[NKPROF_LCD].calls == 1 &&
+                nkprof_totals[NKPROF_LCD].cycles == 400, game);
+
+    // an overflow the interrupt hasn't counted yet is still counted
+    TCNT1 = 0xFFF0;
+    nkprof_start(NKPROF_EEPROM);
+    TCNT1 = 0x10;
+    TIFR1 = 1<<TOV1;
+    nkprof_stop(NKPROF_EEPROM);
+    ASSERT_GAME(nkprof_totals[NKPROF_EEPROM].cycles == 0x20, game);
+    TIFR1 = 0;
+    TIMER1_OVF_vect();
+    ASSERT_GAME(nkprof_now() == 0x10010, game);
+
+    // the game's own routines count themselves
+    bggame_mark_sets(&game);
+    bggame_valid_move_exists(&game);
+    ASSERT_GAME(nkprof_totals[NKPROF_MARK_SETS].calls == 1 &&
+                nkprof_totals[NKPROF_VALID_MOVE].calls == 1 &&
+                nkprof_totals[NKPROF_FILL].calls == 0, game);
+    return PASS;
+}
+#endif
+
 // UTILS
 
+// run the display queue's interrupt until it has nothing left to send
+void drain_queue() {
+    int ticks;
+    for (ticks = 0; ticks < 1000 && (TIMSK2 & (1<<OCIE2A)); ticks++)
+        TIMER2_COMPA_vect();
+}
+
+// check that a preset's routines agree with the generic ones
+int preset_match(game_t *game,
+                 uint8_t (*find_sets)(const game_t*, bgbits_row_t*),
+                 uint8_t (*valid_move_exists)(const game_t*),
+                 uint8_t (*fill_spaces)(game_t*)) {
+    bgbits_row_t marks[MAX_HEIGHT], expect[MAX_HEIGHT];
+    game_t any, preset;
+    int r;
+    if (find_sets(game, marks) != bgpreset_find_sets_any(game, expect) ||
+        valid_move_exists(game) != bgpreset_valid_move_exists_any(game))
+        return 0;
+    for (r = 0; r < game->height; r++)
+        if (marks[r] != expect[r])
+            return 0;
+
+    // knock out the marked pieces (or a few, if there were none)
+    // and refill both ways from the same random state
+    any = *game;
+    if (!bggame_mark_sets(&any)) {
+        any.marks[0] |= 1 << 3;
+        any.marks[1] |= 1 << 3;
+    }
+    bggame_remove_sets(&any);
+    preset = any;
+    if (fill_spaces(&preset) != bgpreset_fill_spaces_any(&any))
+        return 0;
+    return same_board(&preset, &any);
+}
+
+// write a ring record straight into the mock EEPROM
+void put_ring_record(nkeeprom_ring_t *ring, int8_t slot,
+                     const char *payload, uint8_t sequence) {
+    uint16_t address = nkeeprom_ring_address(ring, slot);
+    memcpy(&mock_eeprom[address], payload, ring->size);
+    mock_eeprom[address+ring->size] =
+        nkeeprom_ring_check((unsigned char*)payload, ring->size, sequence);
+    mock_eeprom[address+ring->size+1] = sequence;
+}
+
+// save a record, and wait for it to be written
+void store_save(nkeeprom_tables_t *tables, uint16_t key, const char *text) {
+    static unsigned char src[8];
+    memcpy(src, text, tables->size);
+    nkeeprom_tables_write(tables, key, src);
+    nkeeprom_wait();
+}
+
+// cut the power at every write of the move from the EEPROM's old
+// layout to the store, and return true if the next start always
+// finds the expected table
+uint8_t migrate_torn(const game_t *game, const unsigned char *expect) {
+    static uint8_t image[MOCK_EEPROM_SIZE];
+    unsigned char want[BGHIGHSCORE_BYTES];
+    int budget;
+    uint8_t whole = 0;
+    memcpy(image, mock_eeprom, sizeof(image));
+    memcpy(want, expect, BGHIGHSCORE_BYTES);
+    // until a budget is big enough for the whole move
+    for (budget = 0; !whole; budget++) {
+        memcpy(mock_eeprom, image, sizeof(image));
+        mock_eeprom_budget = budget;
+        bghighscore_init(game);
+        whole = mock_eeprom_budget != 0;
+        mock_eeprom_budget = -1;
+        bghighscore_clear();
+        bghighscore_init(game);
+        if (memcmp(highscores, want, BGHIGHSCORE_BYTES) != 0)
+            return 0;
+    }
+    return 1;
+}
+
+// return true if the store's newest record for a key is text
+uint8_t store_holds(nkeeprom_tables_t *tables, uint16_t key,
+                    const char *text) {
+    unsigned char read[8];
+    return nkeeprom_tables_read(tables, key, read) &&
+        memcmp(read, text, tables->size) == 0;
+}
+
+// fill a board with random pieces, and clear away any sets,
+// the way a game starts
+void random_game(game_t *game, int8_t width, int8_t height, int8_t variety) {
+    game->width = width;
+    game->height = height;
+    game->variety = variety;
+    nkrand_start(&game->random, rand());
+    bggame_board_init(game);
+    do {
+        bggame_remove_sets(game);
+        while (bggame_fill_spaces(game));
+    } while (bggame_mark_sets(game));
+}
+
+// refill one space per row, the way the game used to
+uint8_t reference_fill_step(game_t *game) {
+    int r, c, filled = 0;
+    for (r = 0; r < game->height; r++) {
+        for (c = 0; c < game->width && bggame_type(game, r, c); c++);
+        if (c < game->width) {
+            for (; c < game->width-1; c++)
+                bggame_put(game, r, c, bggame_piece(game, r, c+1));
+            bggame_put(game, r, c, bggame_random_piece(game));
+            filled = 1;
+        }
+    }
+    return filled;
+}
+
+// compare the rows of two boards that are in use by game
+uint8_t same_rows(char (*a)[MAX_WIDTH], char (*b)[MAX_WIDTH],
+                  const game_t *game) {
+    int r;
+    for (r = 0; r < game->height; r++)
+        if (memcmp(a[r], b[r], game->width) != 0)
+            return 0;
+    return 1;
+}
+
+// compare the pieces of two boards of the same size
+uint8_t same_board(const game_t *a, const game_t *b) {
+    char rows_a[MAX_HEIGHT][MAX_WIDTH], rows_b[MAX_HEIGHT][MAX_WIDTH];
+    bggame_read_rows(a, rows_a);
+    bggame_read_rows(b, rows_b);
+    return same_rows(rows_a, rows_b, a);
+}
+
+// set up a game from a string of its pieces, row by row
+void load_game(game_t *game, int8_t width, int8_t height, int8_t variety,
+               const char *pieces) {
+    int8_t r, c;
+    memset(game, 0, sizeof(*game));
+    game->width = width;
+    game->height = height;
+    game->variety = variety;
+    for (r = 0; r < height; r++)
+        for (c = 0; c < width; c++)
+            bggame_put(game, r, c, *pieces++);
+}
+
+// validate a move by swapping and marking the whole board
+uint8_t reference_valid_move(game_t game, point_t a, point_t b) {
+    bggame_swap_pieces(&game, a, b);
+    return bggame_mark_sets(&game);
+}
+
+// mark vertical sets one cell at a time
+void reference_vertical_sets(const game_t *game, bgbits_row_t *marks) {
+    int r, c, i;
+    char piece;
+    for (r = 0; r < game->height; r++)
+        for (c = 0; c < game->width; c++) {
+            piece = bggame_piece(game, r, c);
+            if (piece == ' ' ||
+                piece != bggame_piece(game, (r+1) % game->height, c) ||
+                piece != bggame_piece(game, (r+2) % game->height, c))
+                continue;
+            for (i = 0; i < 3; i++)
+                marks[(r+i) % game->height] |= (bgbits_row_t)1 << c;
+        }
+}
+
+// mark horizontal sets one cell at a time
+void reference_horizontal_sets(const game_t *game, bgbits_row_t *marks) {
+    int r, c, i;
+    char piece;
+    for (r = 0; r < game->height; r++)
+        for (c = 0; c < game->width; c++) {
+            piece = bggame_piece(game, r, c);
+            if (piece == ' ' ||
+                piece != bggame_piece(game, r, (c+1) % game->width) ||
+                piece != bggame_piece(game, r, (c+2) % game->width))
+                continue;
+            for (i = 0; i < 3; i++)
+                marks[r] |= (bgbits_row_t)1 << ((c+i) % game->width);
+        }
+}
+
 void print_game(game_t game) {
     int r, c;
     printf("%d x %d (%d)\n", game.width, game.height, game.variety);
     for (r = 0; r < game.height; r++) {
         printf("   ");
+        // marked pieces print as capitals
         for (c = 0; c < game.width; c++)
-            putchar(game.board[r][c]);
+            putchar((game.marks[r] >> c) & 1 ?
+                    BGGAME_HIGHLIGHT(bggame_piece(&game, r, c)) :
+                    bggame_piece(&game, r, c));
         putchar('\n');
     }
 }
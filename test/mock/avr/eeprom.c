@@ -0,0 +1,58 @@
+/* eeprom.c: Mock EEPROM for testing */
+
+#include <string.h>
+
+#include <inttypes.h>
+#include <avr/pgmspace.h>
+
+// what the EEPROM holds
+uint8_t mock_eeprom[MOCK_EEPROM_SIZE];
+// bytes written so far
+int mock_eeprom_writes = 0;
+// bytes that can still be written before the power goes out, and
+// later writes are lost (-1 is never)
+int mock_eeprom_budget = -1;
+
+uint8_t mock_eecr_value = 0;
+uint8_t mock_eedr_value = 0;
+uint8_t mock_eeprom_in_isr = 0;
+
+// the EEPROM's ready handler (see mock/avr/interrupt.h)
+void EE_READY_vect();
+
+// EECR: a write started by setting EEPE has finished by the next
+// look at the register, and the ready interrupt runs whenever it is
+// enabled and no write is going
+uint8_t *mock_eecr() {
+    if (mock_eecr_value & (1<<EEPE)) {
+        if (mock_eeprom_budget != 0) {
+            mock_eeprom[EEAR % MOCK_EEPROM_SIZE] = mock_eedr_value;
+            mock_eeprom_writes++;
+            if (mock_eeprom_budget > 0)
+                mock_eeprom_budget--;
+        }
+        mock_eecr_value &= ~((1<<EEPE)|(1<<EEMPE));
+    }
+    if ((mock_eecr_value & (1<<EERIE)) && !mock_eeprom_in_isr) {
+        mock_eeprom_in_isr = 1;
+        EE_READY_vect();
+        mock_eeprom_in_isr = 0;
+    }
+    return &mock_eecr_value;
+}
+
+// EEDR: a read started by setting EERE lands here
+uint8_t *mock_eedr() {
+    if (mock_eecr_value & (1<<EERE)) {
+        mock_eedr_value = mock_eeprom[EEAR % MOCK_EEPROM_SIZE];
+        mock_eecr_value &= ~(1<<EERE);
+    }
+    return &mock_eedr_value;
+}
+
+// make the EEPROM look fresh from the factory
+void mock_eeprom_erase() {
+    memset(mock_eeprom, 0xFF, sizeof(mock_eeprom));
+    mock_eeprom_writes = 0;
+    mock_eeprom_budget = -1;
+}
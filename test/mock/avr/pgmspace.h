@@ -3,6 +3,8 @@
 #define __PGMSPACE_H_
 
 #define PSTR(x) x
+#define PROGMEM
+#define pgm_read_byte(x) (*(x))
 
 uint8_t TCCR0A;
 uint8_t TCCR0B;
@@ -11,17 +13,39 @@ uint8_t OCR0A;
 
 uint8_t TIMSK0;
 
+uint8_t TCCR1A;
+uint8_t TCCR1B;
+uint16_t TCNT1;
+uint8_t TIMSK1;
+uint8_t TIFR1;
+
+uint8_t TCCR2A;
+uint8_t TCCR2B;
+uint8_t OCR2A;
+uint8_t TIMSK2;
+
 uint8_t ADMUX;
 uint8_t ADCSRA;
 
-uint8_t EEAR;
-uint8_t EECR;
-uint8_t EEDR;
+uint16_t EEAR;
+// the EEPROM is emulated in eeprom.c, so its control and data
+// registers act on each access (see mock_eecr and mock_eedr)
+#define EECR (*mock_eecr())
+#define EEDR (*mock_eedr())
+#define MOCK_EEPROM_SIZE 512
+extern uint8_t mock_eeprom[MOCK_EEPROM_SIZE];
+extern int mock_eeprom_writes;
+extern int mock_eeprom_budget;
+uint8_t *mock_eecr();
+uint8_t *mock_eedr();
+void mock_eeprom_erase();
+uint8_t SREG;
 
 uint8_t DDRC;
 uint8_t PORTC;
 uint8_t PCMSK1;
 uint8_t PCICR;
+uint8_t PINC;
 
 uint8_t SMCR;
 
@@ -38,7 +62,6 @@ uint8_t SMCR;
 #define PCINT12 0x04
 
 #define PCIE1 0x01
-#define PINC 0x02
 
 #define CS00 0x01
 #define CS02 0x02
@@ -47,6 +70,15 @@ uint8_t SMCR;
 
 #define WGM01 0x01
 
+#define CS10 0x00
+#define TOIE1 0x00
+#define TOV1 0x00
+
+#define CS20 0x00
+#define CS21 0x01
+#define OCIE2A 0x01
+#define WGM21 0x01
+
 #define ADPS0 0x00
 #define ADPS1 0x01
 #define ADPS2 0x02
@@ -58,6 +90,7 @@ uint8_t SMCR;
 #define EEPE 0x01
 #define EERE 0x02
 #define EEMPE 0x03
+#define EERIE 0x04
 
 #define SM1 0x01
 #define SM2 0x02
@@ -3,6 +3,9 @@
 #include <inttypes.h>
 #include <stdio.h>
 
+void set_sleep_mode(uint8_t mode) {
+    printf("%s:%d\n", __FILE__, __LINE__);
+}
 void sleep_cpu() {
     printf("%s:%d\n", __FILE__, __LINE__);
 }
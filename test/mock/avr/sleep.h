@@ -2,6 +2,9 @@
 #ifndef __SLEEP_H_
 #define __SLEEP_H_
 
+#define SLEEP_MODE_IDLE 0
+
+void set_sleep_mode(uint8_t mode);
 void sleep_cpu();
 void sleep_enable();
 void sleep_disable();
@@ -2,11 +2,37 @@
 
 #include <inttypes.h>
 #include <stdio.h>
+#include <string.h>
+
+int mock_lcd_gotos = 0;
+int mock_lcd_writes = 0;
+int mock_lcd_nibbles = 0;
+char mock_lcd_ram[128];
+uint8_t mock_lcd_cursor = 0;
+// whether nibbles are a command, and the high nibble of a byte
+// (-1 until one arrives)
+int mock_lcd_command = 0;
+int mock_lcd_high = -1;
+
+// act on a whole byte, as the display would
+void mock_lcd_byte(uint8_t b) {
+    if (!mock_lcd_command) {
+        mock_lcd_ram[mock_lcd_cursor] = b;
+        mock_lcd_cursor = (mock_lcd_cursor+1) & 0x7F;
+    } else if (b & 0x80) {
+        mock_lcd_cursor = b & 0x7F;
+    } else if (b == 0x01) {
+        memset(mock_lcd_ram, ' ', sizeof(mock_lcd_ram));
+        mock_lcd_cursor = 0;
+    }
+}
 
 void lcd_goto_position(uint8_t row, uint8_t col) {
+    mock_lcd_gotos++;
     printf("%s:%d\n", __FILE__, __LINE__);
 }
 void lcd_write_data(char c) {
+    mock_lcd_writes++;
     printf("%s:%d\n", __FILE__, __LINE__);
 }
 void lcd_clear_and_home() {
@@ -25,6 +51,23 @@ void lcd_init() {
     printf("%s:%d\n", __FILE__, __LINE__);
 }
 void lcd_set_type_command() {
+    mock_lcd_command = 1;
+    mock_lcd_high = -1;
+    printf("%s:%d\n", __FILE__, __LINE__);
+}
+void lcd_set_type_data() {
+    mock_lcd_command = 0;
+    mock_lcd_high = -1;
+    printf("%s:%d\n", __FILE__, __LINE__);
+}
+void lcd_write_nibble(char c) {
+    mock_lcd_nibbles++;
+    if (mock_lcd_high < 0) {
+        mock_lcd_high = c & 0x0F;
+    } else {
+        mock_lcd_byte((mock_lcd_high << 4) | (c & 0x0F));
+        mock_lcd_high = -1;
+    }
     printf("%s:%d\n", __FILE__, __LINE__);
 }
 void lcd_home() {
@@ -2,6 +2,15 @@
 #ifndef __LCD_H
 #define __LCD_H
 
+// call counts, for tests to check how much was sent to the display
+extern int mock_lcd_gotos;
+extern int mock_lcd_writes;
+extern int mock_lcd_nibbles;
+// what the display shows, by display memory address, and the address
+// the next piece goes to (from the nibbles sent)
+extern char mock_lcd_ram[128];
+extern uint8_t mock_lcd_cursor;
+
 void lcd_goto_position(uint8_t row, uint8_t col);
 void lcd_write_data(char c);
 void lcd_clear_and_home();
@@ -10,6 +19,8 @@ void lcd_write_int16(int16_t in);
 void lcd_write_byte(char c);
 void lcd_init();
 void lcd_set_type_command();
+void lcd_set_type_data();
+void lcd_write_nibble(char c);
 void lcd_home();
 
 #endif